@@ -0,0 +1,345 @@
+#ifndef EIM_BENCHMARK_DRIVER_H
+#define EIM_BENCHMARK_DRIVER_H
+
+#include <cstdio>
+#include <jshm.h>
+#include "plugin_scanner.h"
+#include "telemetry.h"
+
+#ifndef JUCE_WINDOWS
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+namespace eim::benchmark {
+    struct config {
+        bool isSharedMemory = false, isRing = false;
+        int sampleRate = 48000, bufferSize = 1024, channels = 2, numBlocks = 2000, numParameters = 2048, load = 0;
+    };
+
+#ifndef JUCE_WINDOWS
+    // A plugin host child process (this executable with --load) driven over its stdin/stdout pipes,
+    // or over shared memory rings once attachRings() succeeded, encoding every message the same way
+    // the engine does.
+    class host_process {
+    public:
+        ~host_process() {
+            if (input) std::fclose(input); // the host quits once its stdin is closed
+            if (output) std::fclose(output);
+            if (pid > 0) waitpid(pid, nullptr, 0);
+        }
+
+        bool start(const juce::StringArray& arguments) {
+            int toHost[2], fromHost[2];
+            if (pipe(toHost) || pipe(fromHost)) return false;
+            auto exe = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getFullPathName();
+            std::vector<std::string> strings { exe.toStdString() };
+            for (auto& it : arguments) strings.emplace_back(it.toStdString());
+            std::vector<char*> argv;
+            for (auto& it : strings) argv.push_back(it.data());
+            argv.push_back(nullptr);
+            pid = fork();
+            if (pid < 0) return false;
+            if (pid == 0) {
+                dup2(toHost[0], 0);
+                dup2(fromHost[1], 1);
+                for (auto fd : { toHost[0], toHost[1], fromHost[0], fromHost[1] }) close(fd);
+                execv(argv[0], argv.data());
+                _exit(127);
+            }
+            close(toHost[0]);
+            close(fromHost[1]);
+            input = fdopen(toHost[1], "wb");
+            output = fdopen(fromHost[0], "rb");
+            return input && output;
+        }
+
+        // Closes the child's stdin and reads everything it prints until it exits.
+        juce::String closeAndReadAll() {
+            if (input) std::fclose(input);
+            input = nullptr;
+            juce::MemoryOutputStream stream;
+            char buf[4096];
+            size_t len;
+            while (output && (len = std::fread(buf, 1, sizeof(buf), output)) > 0) stream.write(buf, len);
+            return stream.toString();
+        }
+
+        // Moves the command stream to shared memory rings (command 6). The pipes stay open so the host
+        // still notices the driver going away.
+        bool attachRings(const juce::String& name, juce::uint32 capacity) {
+            auto ringSize = shm_ring::getMemorySize(capacity);
+            ringShm.reset(jshm::shared_memory::create(name.toRawUTF8(), (int)ringSize * 2));
+            if (!ringShm) return false;
+            write((juce::int8)6);
+            writeString(name);
+            write((juce::int32)capacity);
+            flush();
+            bool ok;
+            if (!read(ok) || !ok) return false;
+            auto address = static_cast<char*>(ringShm->address());
+            commandRing = std::make_unique<shm_ring>(address, capacity);
+            replyRing = std::make_unique<shm_ring>(address + ringSize, capacity);
+            commandRing->bindEvents(name + "_command");
+            replyRing->bindEvents(name + "_reply");
+            return true;
+        }
+
+        template <typename T> void write(T var) { writeArray(&var, 1); }
+        template <typename T> void writeArray(const T* data, int len) {
+            if (commandRing) commandRing->write(data, sizeof(T) * (size_t)len, RING_TIMEOUT_MS);
+            else std::fwrite(data, sizeof(T), (size_t)len, input);
+        }
+        void writeVarInt(juce::int64 var) {
+            while (var >= 0x80) {
+                write((unsigned char)((var & 0x7F) | 0x80));
+                var >>= 7;
+            }
+            write((unsigned char)var);
+        }
+        void writeString(const juce::String& str) {
+            auto raw = str.toRawUTF8();
+            auto len = (int)strlen(raw);
+            writeVarInt(len);
+            writeArray(raw, len);
+        }
+        void flush() {
+            if (commandRing) commandRing->flush();
+            else std::fflush(input);
+        }
+
+        template <typename T> bool read(T& var) { return readArray(&var, 1); }
+        template <typename T> bool readArray(T* data, int len) {
+            if (replyRing) return replyRing->read(data, sizeof(T) * (size_t)len, RING_TIMEOUT_MS) == sizeof(T) * (size_t)len;
+            return std::fread(data, sizeof(T), (size_t)len, output) == (size_t)len;
+        }
+        bool readVarInt(int& var) {
+            var = 0;
+            for (int i = 0; i <= 28; i += 7) {
+                unsigned char b;
+                if (!read(b)) return false;
+                var |= (int)(b & 0x7F) << i;
+                if ((b & 0x80) == 0) return true;
+            }
+            return true;
+        }
+        bool skip(int bytes) {
+            char buf[256];
+            for (; bytes > 0; bytes -= (int)sizeof(buf)) if (!readArray(buf, juce::jmin(bytes, (int)sizeof(buf)))) return false;
+            return true;
+        }
+        bool skipString() {
+            int len;
+            return readVarInt(len) && skip(len);
+        }
+
+        // Reads the actions the host sends until the end of a block (action 1), or the initial action 0;
+        // in the latter case anything else ending the read is a failure.
+        bool readActions(bool untilInitInformation) {
+            juce::int8 action;
+            while (read(action)) {
+                switch (action) {
+                    case 0: {
+                        juce::int8 numInputs, numOutputs;
+                        juce::int32 latency;
+                        int numParameters;
+                        if (!read(numInputs) || !read(numOutputs) || !read(latency) || !readVarInt(numParameters)) return false;
+                        for (int i = 0; i < numParameters; i++) {
+                            int numValueStrings;
+                            if (!skip(1 + 4 + 4 + 4 + 4) || !skipString() || !skipString() || !readVarInt(numValueStrings)) return false;
+                            for (int j = 0; j < numValueStrings; j++) if (!skipString()) return false;
+                        }
+                        if (untilInitInformation) return true;
+                        break;
+                    }
+                    case 1: return !untilInitInformation;
+                    case 2: if (!skip(1)) return false; break;
+                    case 3: {
+                        int count, id;
+                        if (!readVarInt(count)) return false;
+                        for (int i = 0; i < count; i++) if (!readVarInt(id) || !skip(4)) return false;
+                        break;
+                    }
+                    case 4: if (!skip(4)) return false; break;
+                    case 5: if (!skip(1)) return false; break;
+                    case 9: if (!skip(4 + 4 + 4 + 3 * 4 * 4)) return false; break;
+                    case 127:
+                        skipString();
+                        return false;
+                    default:
+                        std::cerr << "Unexpected action " << (int)action << '\n';
+                        return false;
+                }
+            }
+            return false;
+        }
+
+    private:
+        static constexpr int RING_TIMEOUT_MS = 10000;
+        pid_t pid = -1;
+        FILE* input = nullptr;
+        FILE* output = nullptr;
+        std::unique_ptr<jshm::shared_memory> ringShm;
+        std::unique_ptr<shm_ring> commandRing, replyRing; // declared after ringShm, so released before it
+    };
+
+    // Loads the test processor in a fresh host process and measures the round trip of every block,
+    // from sending the request to having read all output channels.
+    inline bool measure(const config& cfg, telemetry::histogram& roundTrip, double& realtimeFactor) {
+        auto desc = new juce::DynamicObject();
+        desc->setProperty("pluginFormatName", "EIMBenchmark");
+        desc->setProperty("channels", cfg.channels);
+        desc->setProperty("parameters", cfg.numParameters);
+        desc->setProperty("load", cfg.load);
+        host_process host;
+        short byteOrder;
+        if (!host.start({ "-L", juce::JSON::toString(juce::var(desc), true) }) || !host.read(byteOrder)) return false;
+        if (!host.readActions(true)) { // nothing is timed unless the test processor actually loaded
+            std::cerr << "The host did not send its init information (action 0)\n";
+            return false;
+        }
+
+        auto samples = cfg.channels * cfg.bufferSize;
+        std::unique_ptr<jshm::shared_memory> shm;
+        host.write((juce::int8)0);
+        host.write((juce::int32)cfg.sampleRate);
+        host.write((juce::int32)cfg.bufferSize);
+        host.write(cfg.isSharedMemory);
+        if (cfg.isSharedMemory) {
+            auto name = "EIMBench" + juce::String(getpid()) + "_" + juce::String(cfg.bufferSize) + "_" + juce::String(cfg.channels);
+            shm.reset(jshm::shared_memory::create(name.toRawUTF8(), samples * (int)sizeof(float)));
+            if (!shm) return false;
+            host.writeString(name);
+            host.write((juce::int32)(samples * (int)sizeof(float)));
+        }
+        host.flush();
+        if (cfg.isRing && !host.attachRings("EIMBenchRing" + juce::String(getpid()) + "_" + juce::String(cfg.bufferSize)
+            + "_" + juce::String(cfg.channels), 1 << 20)) return false;
+
+        juce::HeapBlock<float> audio((size_t)samples, true);
+        for (int i = 0; i < samples; i++) audio[i] = (float)std::sin(i * 0.01) * 0.5f;
+        auto warmup = juce::jmin(100, cfg.numBlocks / 10);
+        double elapsed = 0;
+        for (int b = 0; b < warmup + cfg.numBlocks; b++) {
+            auto start = telemetry::now();
+            if (shm) std::memcpy(shm->address(), audio.get(), (size_t)samples * sizeof(float));
+            host.write((juce::int8)1);
+            host.write((juce::int8)0b1001); // playing, realtime
+            host.write(120.0);
+            host.write((juce::int16)0);
+            host.writeVarInt((juce::int64)b * cfg.bufferSize);
+            if (!shm) {
+                host.write((juce::int8)cfg.channels);
+                host.write((juce::int8)cfg.channels);
+                host.writeArray(audio.get(), samples);
+            }
+            host.writeVarInt(0); // parameter changes
+            host.flush();
+            if (!host.readActions(false)) return false;
+            if (shm) std::memcpy(audio.get(), shm->address(), (size_t)samples * sizeof(float));
+            else if (!host.readArray(audio.get(), samples)) return false;
+            auto micros = telemetry::now() - start;
+            if (b < warmup) continue;
+            roundTrip.record(micros);
+            elapsed += micros;
+        }
+        realtimeFactor = (double)cfg.numBlocks * cfg.bufferSize / cfg.sampleRate * 1000000.0 / juce::jmax(1.0, elapsed);
+        return true;
+    }
+#endif
+
+    // Runs one real batch scan end to end (--scan-check [plugin_file]): this executable is started with
+    // --scan-batch, which scans the file in a child started with --scan, and the result must be "ok".
+    // Without a file the first plugin found in the default search paths is used.
+    inline int scanCheck(const juce::ArgumentList& args) {
+#ifdef JUCE_WINDOWS
+        juce::ignoreUnused(args);
+        std::cerr << "The scan check is only supported on POSIX systems\n";
+        return 1;
+#else
+        std::signal(SIGPIPE, SIG_IGN);
+        auto path = utils::getOptionFile(args, "--scan-check").getFullPathName();
+        if (path.isEmpty()) {
+            juce::AudioPluginFormatManager manager;
+            manager.addDefaultFormats();
+            for (auto format : manager.getFormats()) {
+                auto found = format->searchPathsForPlugins(format->getDefaultLocationsToSearch(), true, true);
+                if (!found.isEmpty()) {
+                    path = found[0];
+                    break;
+                }
+            }
+            if (path.isEmpty()) {
+                std::printf("scan check skipped: no plugin found in the default search paths\n");
+                return 0;
+            }
+        }
+        host_process batch;
+        if (!batch.start({ "--scan-batch", "--no-cache", "--jobs", "1" })) return 1;
+        batch.writeArray(path.toRawUTF8(), (int)strlen(path.toRawUTF8()));
+        batch.write('\n');
+        auto output = batch.closeAndReadAll();
+        auto start = output.indexOf(scanner::RESULT_PREFIX), end = output.lastIndexOf(scanner::RESULT_SUFFIX);
+        auto result = start < 0 || end < start ? juce::var()
+            : juce::JSON::parse(output.substring(start + (int)strlen(scanner::RESULT_PREFIX), end));
+        auto status = result.getProperty("status", "no result").toString();
+        std::printf("scan check %s: %s, %d plugin(s)\n", path.toRawUTF8(), status.toRawUTF8(), result.getProperty("plugins", {}).size());
+        return status == "ok" ? 0 : 1;
+#endif
+    }
+
+    inline juce::Array<int> parseList(const juce::ArgumentList& args, const juce::String& option, const juce::String& fallback) {
+        juce::Array<int> list;
+        auto value = args.containsOption(option) ? utils::getOptionValue(args, option) : fallback;
+        for (auto& it : juce::StringArray::fromTokens(value, ",", "")) list.add(it.getIntValue());
+        return list;
+    }
+
+    // Runs every combination of transport, buffer size and channel count and prints one line each.
+    inline int run(const juce::ArgumentList& args) {
+#ifdef JUCE_WINDOWS
+        juce::ignoreUnused(args);
+        std::cerr << "The benchmark driver is only supported on POSIX systems\n";
+        return 1;
+#else
+        std::signal(SIGPIPE, SIG_IGN);
+        config base;
+        if (args.containsOption("--blocks")) base.numBlocks = juce::jmax(1, utils::getOptionValue(args, "--blocks").getIntValue());
+        if (args.containsOption("--parameters")) base.numParameters = juce::jmax(0, utils::getOptionValue(args, "--parameters").getIntValue());
+        if (args.containsOption("--dsp-load")) base.load = juce::jmax(0, utils::getOptionValue(args, "--dsp-load").getIntValue());
+        if (args.containsOption("-R|--sampleRate")) base.sampleRate = utils::getOptionValue(args, "-R|--sampleRate").getIntValue();
+        auto transports = args.containsOption("--transport") ? juce::StringArray::fromTokens(utils::getOptionValue(args, "--transport"), ",", "")
+            : juce::StringArray { "stdio", "shm", "ring" };
+
+        std::printf("%-6s %6s %4s %10s %10s %10s %10s %10s\n", "io", "buffer", "ch", "min_us", "avg_us", "p99_us", "max_us", "x_rt");
+        auto failed = false;
+        for (auto& transport : transports) {
+            for (auto bufferSize : parseList(args, "-B|--buffer-sizes", "32,64,128,256,512,1024,2048,4096")) {
+                for (auto channels : parseList(args, "-C|--channels", "2,8")) {
+                    auto cfg = base;
+                    cfg.isSharedMemory = transport == "shm" || transport == "ring";
+                    cfg.isRing = transport == "ring";
+                    cfg.bufferSize = bufferSize;
+                    cfg.channels = channels;
+                    telemetry::histogram roundTrip;
+                    double realtimeFactor = 0;
+                    if (!measure(cfg, roundTrip, realtimeFactor)) {
+                        std::printf("%-6s %6d %4d failed\n", transport.toRawUTF8(), bufferSize, channels);
+                        failed = true;
+                        continue;
+                    }
+                    float summary[4];
+                    roundTrip.getSummary(summary);
+                    std::printf("%-6s %6d %4d %10.1f %10.1f %10.1f %10.1f %10.1f\n", transport.toRawUTF8(), bufferSize, channels,
+                        summary[0], summary[1], summary[2], summary[3], realtimeFactor);
+                    std::fflush(stdout);
+                }
+            }
+        }
+        return failed ? 1 : 0;
+#endif
+    }
+}
+
+#endif
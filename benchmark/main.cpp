@@ -0,0 +1,22 @@
+#include "plugin_host.h"
+#include "test_processor.h"
+#include "driver.h"
+
+// Started without --load this is the benchmark driver; it spawns itself with --load as the plugin
+// host, hosting the built-in test processor through the regular plugin_host code. The scan modes
+// are the regular scanner's, so --scan-check can run a batch scan through this executable.
+int main(int argc, char* argv[]) {
+    auto args = new juce::ArgumentList(argc, argv);
+    eim::args = args;
+    eim::createBuiltInInstance = eim::benchmark::test_processor::create;
+
+    if (args->containsOption("-L|--load")) {
+        eim::streams::preventStdout();
+        juce::JUCEApplicationBase::createInstance = eim::plugin_host::createInstance;
+        return juce::JUCEApplicationBase::main(argc, (const char**)argv);
+    }
+    if (args->containsOption("-S|--scan")) return eim::scanner::runScan(*args);
+    if (args->containsOption("--scan-batch")) return eim::scanner::runScanBatch(*args);
+    if (args->containsOption("--scan-check")) return eim::benchmark::scanCheck(*args);
+    return eim::benchmark::run(*args);
+}
@@ -0,0 +1,105 @@
+#ifndef EIM_BENCHMARK_TEST_PROCESSOR_H
+#define EIM_BENCHMARK_TEST_PROCESSOR_H
+
+#include <cmath>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+namespace eim::benchmark {
+    // Built-in plugin used by the benchmark instead of a real one: passes audio through, burns a
+    // configurable amount of DSP per sample and exposes many parameters. Created from a description
+    // like { "pluginFormatName": "EIMBenchmark", "channels": 2, "parameters": 2048, "load": 0 }.
+    class test_processor : public juce::AudioPluginInstance {
+    public:
+        test_processor(int channels, int numParameters, int _load) : juce::AudioPluginInstance(BusesProperties()
+            .withInput("Input", juce::AudioChannelSet::canonicalChannelSet(channels), true)
+            .withOutput("Output", juce::AudioChannelSet::canonicalChannelSet(channels), true)), load(_load) {
+            for (int i = 0; i < numParameters; i++) addHostedParameter(std::make_unique<parameter>(i));
+        }
+
+        static std::unique_ptr<juce::AudioPluginInstance> create(const juce::var& json) {
+            if (json.getProperty("pluginFormatName", "").toString() != "EIMBenchmark") return nullptr;
+            return std::make_unique<test_processor>(juce::jlimit(1, 64, (int)json.getProperty("channels", 2)),
+                juce::jmax(0, (int)json.getProperty("parameters", 0)), juce::jmax(0, (int)json.getProperty("load", 0)));
+        }
+
+        void fillInPluginDescription(juce::PluginDescription& description) const override {
+            description.name = getName();
+            description.pluginFormatName = "EIMBenchmark";
+            description.manufacturerName = "EchoInMirror";
+            description.numInputChannels = getTotalNumInputChannels();
+            description.numOutputChannels = getTotalNumOutputChannels();
+        }
+
+        const juce::String getName() const override { return "EIMBenchmark"; }
+
+        void prepareToPlay(double, int) override { phase = 0; }
+        void releaseResources() override { }
+
+        void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override { burn(buffer); }
+        void processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer&) override { burn(buffer); }
+        bool supportsDoublePrecisionProcessing() const override { return true; }
+
+        double getTailLengthSeconds() const override { return 0; }
+        bool acceptsMidi() const override { return true; }
+        bool producesMidi() const override { return false; }
+
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override { }
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String&) override { }
+
+        void getStateInformation(juce::MemoryBlock& destData) override {
+            juce::MemoryOutputStream stream(destData, false);
+            for (auto param : getParameters()) stream.writeFloat(param->getValue());
+        }
+
+        void setStateInformation(const void* data, int sizeInBytes) override {
+            juce::MemoryInputStream stream(data, (size_t)sizeInBytes, false);
+            for (auto param : getParameters()) if (!stream.isExhausted()) param->setValue(stream.readFloat());
+        }
+
+    private:
+        class parameter : public juce::HostedAudioProcessorParameter {
+        public:
+            explicit parameter(int _index) : index(_index) { }
+
+            juce::String getParameterID() const override { return juce::String(index); }
+            float getValue() const override { return value; }
+            void setValue(float newValue) override { value = newValue; }
+            float getDefaultValue() const override { return 0.5f; }
+            juce::String getName(int maximumStringLength) const override { return ("Parameter " + juce::String(index)).substring(0, maximumStringLength); }
+            juce::String getLabel() const override { return {}; }
+            float getValueForText(const juce::String& text) const override { return text.getFloatValue(); }
+
+        private:
+            int index;
+            std::atomic<float> value { 0.5f };
+        };
+
+        int load;
+        double phase = 0;
+
+        // `load` rounds of transcendental math per sample and channel, added back at an inaudible level
+        // so the work cannot be optimized away.
+        template <typename T> void burn(juce::AudioBuffer<T>& buffer) {
+            if (load == 0) return;
+            for (int ch = 0; ch < buffer.getNumChannels(); ch++) {
+                auto data = buffer.getWritePointer(ch);
+                for (int i = 0; i < buffer.getNumSamples(); i++) {
+                    auto acc = phase;
+                    for (int j = 0; j < load; j++) acc = std::sin(acc + (double)data[i]) * 0.999;
+                    data[i] += (T)(acc * 1e-9);
+                }
+            }
+            phase += 0.01;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(test_processor)
+    };
+}
+
+#endif
@@ -1,85 +1,117 @@
 #include <juce_audio_devices/juce_audio_devices.h>
 #include <jshm.h>
 #include "utils.h"
+#include "realtime.h"
+#include "telemetry.h"
+#include "resampler.h"
 
 namespace eim {
-    class audio_output : public juce::AudioIODeviceCallback {
+    // Control block at the start of the shared memory segment when the engine drives the device
+    // through shared memory (--sync). It is followed at AUDIO_SHM_HEADER_SIZE by `depth` slots of
+    // numOutputChannels * bufferSize floats each; block n lives in slot n % depth. With --inputs the
+    // output slots are followed by `depth` input slots of one audio_input_slot and numInputChannels *
+    // bufferSize floats each, filled before block n is requested.
+    struct audio_shm_header {
+        std::atomic<juce::uint32> requestSeq; // blocks requested so far, bumped by the device callback
+        std::atomic<juce::uint32> responseSeq; // blocks written so far, at most depth - 1 ahead of requestSeq
+        std::atomic<juce::uint32> command; // 1 = open control panel, 2 = restart, reset to 0 once handled
+        std::atomic<juce::uint32> numOutputChannels;
+        std::atomic<juce::uint32> underruns; // blocks replaced by silence because the engine missed the deadline
+        std::atomic<juce::uint32> depth; // render-ahead slots, written by the host
+        std::atomic<juce::uint32> statsSeq; // odd while the host rewrites `stats` (--telemetry), even otherwise
+        telemetry::callback_telemetry::summary stats;
+        std::atomic<juce::uint32> numInputChannels; // captured input planes per input slot, written by the host
+    };
+    struct audio_input_slot {
+        juce::int64 hostTimeNs; // when the device delivered the input
+        juce::int64 samplePosition; // device samples captured before this block since the device started
+    };
+    constexpr int AUDIO_SHM_HEADER_SIZE = 256;
+    static_assert(sizeof(audio_shm_header) <= AUDIO_SHM_HEADER_SIZE);
+
+    class audio_output : public juce::AudioIODeviceCallback, private juce::AsyncUpdater {
     public:
         audio_output(juce::AudioDeviceManager& _deviceManager, juce::AudioDeviceManager::AudioDeviceSetup& _setup,
-            const juce::String& shmName, int memorySize) : deviceManager(_deviceManager), setup(_setup) {
+            const juce::String& shmName, int memorySize, bool _isSync, int _deadlineMicros, int _depth, int _numInputs)
+            : deviceManager(_deviceManager), setup(_setup), isSync(_isSync && shmName.isNotEmpty()),
+            deadlineMicros(_deadlineMicros), depth((juce::uint32)juce::jmax(1, _depth)), numInputs(juce::jmax(0, _numInputs)),
+            projectRate((int)_setup.sampleRate), isResampleEnabled(args->containsOption("--resample")),
+            realtime(utils::realtime_options::parse(*args)) {
+            if (args->containsOption("--telemetry")) {
+                auto interval = utils::getOptionValue(*args, "--telemetry").getIntValue();
+                callbackTelemetry = std::make_unique<telemetry::callback_telemetry>(interval > 0 ? interval : 1000);
+            }
             if (shmName.isNotEmpty()) {
                 shm.reset(jshm::shared_memory::open(shmName.toRawUTF8(), memorySize));
+                shmSize = (size_t)juce::jmax(0, memorySize);
                 if (!shm) exit();
+                else if (isSync) resetHeader();
             }
         }
         ~audio_output() override {
+            if (shm) sync::unbindEvents(shm->address(), shmSize);
             shm.reset();
         }
 
-        void audioDeviceIOCallbackWithContext(const float* const*, int, float* const* outputChannelData, int, int, const juce::AudioIODeviceCallbackContext&) override {
-            streams::output().writeAction(0);
-            streams::output().flush();
-            juce::int8 id;
-            if (streams::input().read(id) != 1) {
-                exit();
-                return;
+        void audioDeviceIOCallbackWithContext(const float* const* inputChannelData, int numInputChannels, float* const* outputChannelData,
+                                              int numOutputChannels, int numSamples, const juce::AudioIODeviceCallbackContext& context) override {
+            if (!isPriorityApplied) { // the driver owns this thread, so raise it on its first callback
+                isPriorityApplied = true;
+                if (!realtime.apply()) triggerAsyncUpdate(); // reported on the message thread
             }
-            switch (id) {
-            case 0: {
-                juce::int8 numOutputChannels;
-                streams::input() >> numOutputChannels;
-                if (shm) {
-                    auto inData = reinterpret_cast<float*>(shm->address());
-                    for (int i = 0; i < numOutputChannels; i++)
-                        std::memcpy(outputChannelData[i], inData + i * setup.bufferSize, (size_t) setup.bufferSize * sizeof(float));
-                } else for (int i = 0; i < numOutputChannels; i++) streams::input().readArray(outputChannelData[i], setup.bufferSize);
-                break;
-            }
-            case 1:
-                openControlPanel();
-                break;
-            case 2: {
-                isRestarting = true;
-                deviceManager.closeAudioDevice();
-                std::thread restartingThread([this] {
-                    juce::int8 id2;
-                    do {
-                        if (streams::input().read(id2) != 1) {
-                            exit();
-                            return;
-                        }
-                        deviceManager.restartLastAudioDevice();
-                    } while (id2 != 3);
-                });
-                restartingThread.detach();
-                break;
-            }
-            default: exit();
+            callbackDeadline = sync::clock::now() + deadline; // shared by every block this callback requests
+            auto hostTimeNs = context.hostTimeNs ? (juce::int64)*context.hostTimeNs : (juce::int64)(telemetry::now() * 1000.0);
+            if (callbackTelemetry) callbackTelemetry->recordCallback((double)hostTimeNs / 1000.0);
+            if (isResampling) {
+                renderResampled(outputChannelData, numOutputChannels, numSamples, hostTimeNs);
+                return;
             }
+            renderBlock(outputChannelData, numOutputChannels, numSamples, inputChannelData, juce::jmin(numCapturedInputs, numInputChannels), hostTimeNs);
         }
 
         void audioDeviceAboutToStart(juce::AudioIODevice* device) override {
+            isPriorityApplied = false;
             auto bufSize = device->getCurrentBufferSizeSamples();
             auto bufferSizes = device->getAvailableBufferSizes();
             auto sampleRates = device->getAvailableSampleRates();
+            auto deviceRate = (int)device->getCurrentSampleRate();
+            auto numOutputChannels = juce::jmax(1, device->getActiveOutputChannels().countNumberOfSetBits());
+            isResampling = isResampleEnabled && deviceRate != projectRate && resample.prepare(numOutputChannels, projectRate, deviceRate, bufSize);
+            if (isResampling) engineBlock.setSize(numOutputChannels, bufSize);
             streams::output().writeAction(1);
             streams::output() << ("[" + device->getTypeName() + "] " + device->getName());
             streams::output().writeVarInt(device->getInputLatencyInSamples());
-            streams::output().writeVarInt(device->getOutputLatencyInSamples());
-            streams::output().writeVarInt((int)device->getCurrentSampleRate());
+            streams::output().writeVarInt(device->getOutputLatencyInSamples() + (isResampling ? resample.getLatency() : 0));
+            streams::output().writeVarInt(isResampling ? projectRate : deviceRate); // the engine keeps the project rate
             streams::output().writeVarInt(bufSize);
             streams::output().writeVarInt(sampleRates.size());
             for (auto it : sampleRates) streams::output().writeVarInt((int)it);
             streams::output().writeVarInt(bufferSizes.size());
             for (int it : bufferSizes) streams::output().writeVarInt(it);
             streams::output() << device->hasControlPanel();
+            numCapturedInputs = isResampling ? 0 : juce::jmin(numInputs, device->getActiveInputChannels().countNumberOfSetBits());
+            if (numInputs > 0) streams::output().writeVarInt(numCapturedInputs);
             streams::output().flush();
             int outBufferSize;
             streams::input() >> outBufferSize;
             if (setup.bufferSize != bufSize) setup.bufferSize = bufSize;
-            if (shm && outBufferSize) shm.reset(jshm::shared_memory::open(shm->name(), outBufferSize));
+            if (shm && outBufferSize) {
+                sync::unbindEvents(shm->address(), shmSize);
+                shm.reset(jshm::shared_memory::open(shm->name(), outBufferSize));
+                shmSize = (size_t)outBufferSize;
+                if (shm && isSync) resetHeader();
+            }
+            if (shm && isSync) static_cast<audio_shm_header*>(shm->address())->numInputChannels.store((juce::uint32)numCapturedInputs);
+            auto period = (double)bufSize / device->getCurrentSampleRate();
+            deadline = std::chrono::microseconds(deadlineMicros > 0 ? deadlineMicros : (juce::int64)(period * 750000.0));
+            periodMicros = period * 1000000.0;
+            if (callbackTelemetry) callbackTelemetry->setPeriod(periodMicros);
+            missedSince = {};
+            samplePosition = 0;
         }
 
+        void handleAsyncUpdate() override { utils::warnRealtimeFailed(); }
+
         void audioDeviceStopped() override {
             if (isRestarting) isRestarting = false;
             else exit();
@@ -109,6 +141,22 @@ namespace eim {
             });
         }
 
+        void restartDevice() {
+            isRestarting = true;
+            deviceManager.closeAudioDevice();
+            std::thread restartingThread([this] {
+                juce::int8 id2;
+                do {
+                    if (streams::input().read(id2) != 1) {
+                        exit();
+                        return;
+                    }
+                    deviceManager.restartLastAudioDevice();
+                } while (id2 != 3);
+            });
+            restartingThread.detach();
+        }
+
         [[nodiscard]] int getExitCode() const { return isErrorExit; }
 
         static void exit() {
@@ -116,9 +164,180 @@ namespace eim {
         }
 
     private:
+        static constexpr auto ENGINE_TIMEOUT = std::chrono::seconds(10);
+
         std::unique_ptr<jshm::shared_memory> shm;
-        bool isErrorExit = false, isRestarting = false;
+        bool isErrorExit = false, isRestarting = false, isPriorityApplied = false;
         juce::AudioDeviceManager& deviceManager;
         juce::AudioDeviceManager::AudioDeviceSetup& setup;
+        bool isSync;
+        int deadlineMicros;
+        juce::uint32 depth;
+        int numInputs, numCapturedInputs = 0;
+        size_t shmSize = 0;
+        int projectRate;
+        bool isResampleEnabled, isResampling = false;
+        utils::realtime_options realtime;
+        resampler resample;
+        juce::AudioBuffer<float> engineBlock;
+        juce::int64 samplePosition = 0;
+        sync::clock::duration deadline{};
+        sync::clock::time_point missedSince{}, callbackDeadline{};
+        std::unique_ptr<telemetry::callback_telemetry> callbackTelemetry;
+        double periodMicros = 0;
+
+        // Asks the engine for one block; returns false when it answered with a command instead of audio.
+        bool renderBlock(float* const* outputChannelData, int numOutputChannels, int numSamples,
+                         const float* const* inputChannelData, int capturedChannels, juce::int64 hostTimeNs) {
+            if (isSync) {
+                auto isRendered = processSharedBlock(outputChannelData, numOutputChannels, numSamples, inputChannelData, capturedChannels, hostTimeNs);
+                samplePosition += numSamples;
+                if (callbackTelemetry && callbackTelemetry->isDue()) publishStats();
+                return isRendered;
+            }
+            if (callbackTelemetry && callbackTelemetry->isDue()) callbackTelemetry->writeReport(streams::output());
+            auto requested = callbackTelemetry ? telemetry::now() : 0.0;
+            streams::output().writeAction(0);
+            if (numInputs > 0) { // --inputs: int64 host time (ns), int64 sample position, int8 channels, then the planes
+                streams::output() << hostTimeNs << samplePosition << (juce::int8)numCapturedInputs;
+                for (int i = 0; i < numCapturedInputs; i++) {
+                    if (i < capturedChannels && inputChannelData[i]) streams::output().writeArray(inputChannelData[i], numSamples);
+                    else for (int j = 0; j < numSamples; j++) streams::output() << 0.0f;
+                }
+            }
+            samplePosition += numSamples;
+            streams::output().flush();
+            juce::int8 id;
+            if (streams::input().read(id) != 1) {
+                exit();
+                return false;
+            }
+            switch (id) {
+            case 0: {
+                juce::int8 engineChannels;
+                streams::input() >> engineChannels;
+                auto channels = juce::jmin((int)engineChannels, numOutputChannels);
+                if (shm) {
+                    auto inData = reinterpret_cast<float*>(shm->address());
+                    for (int i = 0; i < channels; i++)
+                        std::memcpy(outputChannelData[i], inData + i * setup.bufferSize, (size_t) setup.bufferSize * sizeof(float));
+                } else {
+                    for (int i = 0; i < channels; i++) streams::input().readArray(outputChannelData[i], setup.bufferSize);
+                    for (int i = channels; i < engineChannels; i++) streams::input().skip(setup.bufferSize * (int)sizeof(float));
+                }
+                if (callbackTelemetry) {
+                    auto elapsed = telemetry::now() - requested;
+                    callbackTelemetry->recordResponse(elapsed, elapsed > periodMicros);
+                }
+                return true;
+            }
+            case 1:
+                openControlPanel();
+                break;
+            case 2:
+                restartDevice();
+                break;
+            default: exit();
+            }
+            return false;
+        }
+
+        // Pulls engine blocks at the project rate until the resampler holds a device block.
+        void renderResampled(float* const* outputChannelData, int numOutputChannels, int numSamples, juce::int64 hostTimeNs) {
+            while (resample.getNumReady() < numSamples) {
+                engineBlock.clear();
+                if (!renderBlock(engineBlock.getArrayOfWritePointers(), engineBlock.getNumChannels(), setup.bufferSize, nullptr, 0, hostTimeNs)) break;
+                resample.push(engineBlock.getArrayOfReadPointers(), setup.bufferSize);
+            }
+            resample.pop(outputChannelData, numOutputChannels, numSamples);
+        }
+
+        void resetHeader() {
+            auto header = new (shm->address()) audio_shm_header();
+            sync::bindEvent(header->requestSeq, juce::String(shm->name()) + "_request");
+            sync::bindEvent(header->responseSeq, juce::String(shm->name()) + "_response");
+            header->depth.store(depth);
+            header->numInputChannels.store((juce::uint32)numCapturedInputs);
+        }
+
+        void publishStats() {
+            auto header = static_cast<audio_shm_header*>(shm->address());
+            auto summary = callbackTelemetry->takeSummary();
+            header->statsSeq.fetch_add(1, std::memory_order_acq_rel);
+            header->stats = summary;
+            header->statsSeq.fetch_add(1, std::memory_order_release);
+        }
+
+        // Requests the next block through the shared memory sequence counters. The engine may have
+        // rendered it ahead of time into its slot; otherwise we wait until the callback's deadline (shared
+        // by all blocks a resampled callback pulls), so a late engine costs silence instead of stalling
+        // the driver thread.
+        bool processSharedBlock(float* const* outputChannelData, int numOutputChannels, int numSamples,
+                                const float* const* inputChannelData, int numInputChannels, juce::int64 hostTimeNs) {
+            auto header = static_cast<audio_shm_header*>(shm->address());
+            switch (header->command.exchange(0)) {
+            case 0: break;
+            case 1:
+                openControlPanel();
+                break;
+            case 2:
+                for (int i = 0; i < numOutputChannels; i++) juce::FloatVectorOperations::clear(outputChannelData[i], numSamples);
+                restartDevice();
+                return false;
+            default: exit();
+            }
+
+            auto block = header->requestSeq.load(std::memory_order_relaxed);
+            if (numCapturedInputs > 0) captureInputs(header, block, inputChannelData, numInputChannels, numSamples, hostTimeNs);
+            auto requested = sync::clock::now();
+            auto timeout = callbackDeadline;
+            header->requestSeq.store(block + 1, std::memory_order_release);
+            sync::wake(header->requestSeq);
+
+            auto response = header->responseSeq.load(std::memory_order_acquire);
+            while ((juce::int32)(response - block) <= 0 && sync::waitUntil(header->responseSeq, response, timeout))
+                response = header->responseSeq.load(std::memory_order_acquire);
+            if (callbackTelemetry) callbackTelemetry->recordResponse(
+                std::chrono::duration<double, std::micro>(sync::clock::now() - requested).count(), (juce::int32)(response - block) <= 0);
+            if ((juce::int32)(response - block) <= 0) {
+                for (int i = 0; i < numOutputChannels; i++) juce::FloatVectorOperations::clear(outputChannelData[i], numSamples);
+                header->underruns.fetch_add(1, std::memory_order_relaxed);
+                auto now = sync::clock::now();
+                if (missedSince == sync::clock::time_point{}) missedSince = now;
+                else if (now - missedSince > ENGINE_TIMEOUT) exit(); // the engine is gone
+                return true;
+            }
+            missedSince = {};
+
+            auto engineChannels = (int)header->numOutputChannels.load();
+            auto channels = juce::jmin(numOutputChannels, engineChannels);
+            auto slot = reinterpret_cast<float*>(static_cast<char*>(shm->address()) + AUDIO_SHM_HEADER_SIZE)
+                + (size_t)(block % depth) * (size_t)engineChannels * (size_t)setup.bufferSize;
+            for (int i = 0; i < channels; i++)
+                std::memcpy(outputChannelData[i], slot + i * setup.bufferSize, (size_t) numSamples * sizeof(float));
+            for (int i = channels; i < numOutputChannels; i++) juce::FloatVectorOperations::clear(outputChannelData[i], numSamples);
+            return true;
+        }
+
+        // Copies the captured input of `block` into its input slot; published by the requestSeq bump
+        // that follows, so the engine sees input and request together.
+        void captureInputs(audio_shm_header* header, juce::uint32 block, const float* const* inputChannelData,
+                           int numInputChannels, int numSamples, juce::int64 hostTimeNs) {
+            auto outputSize = (size_t)depth * header->numOutputChannels.load() * (size_t)setup.bufferSize * sizeof(float);
+            auto slotSize = sizeof(audio_input_slot) + (size_t)numCapturedInputs * (size_t)setup.bufferSize * sizeof(float);
+            auto offset = AUDIO_SHM_HEADER_SIZE + outputSize + (size_t)(block % depth) * slotSize;
+            if (offset + slotSize > shmSize) return; // the engine did not reserve room for the inputs
+            auto base = static_cast<char*>(shm->address()) + offset;
+            auto slot = reinterpret_cast<audio_input_slot*>(base);
+            slot->hostTimeNs = hostTimeNs;
+            slot->samplePosition = samplePosition;
+            auto planes = reinterpret_cast<float*>(base + sizeof(audio_input_slot));
+            numSamples = juce::jmin(numSamples, setup.bufferSize);
+            for (int i = 0; i < numCapturedInputs; i++) {
+                auto plane = planes + (size_t)i * (size_t)setup.bufferSize;
+                if (i < numInputChannels && inputChannelData[i]) std::memcpy(plane, inputChannelData[i], (size_t)numSamples * sizeof(float));
+                else juce::FloatVectorOperations::clear(plane, numSamples);
+            }
+        }
     };
 }
\ No newline at end of file
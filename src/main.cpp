@@ -1,5 +1,7 @@
 #include "plugin_host.h"
 #include "audio_output.h"
+#include "offline_renderer.h"
+#include "plugin_scanner.h"
 
 #if JUCE_MAC
 namespace juce { extern void initialiseNSApplication(); }
@@ -25,57 +27,28 @@ int main(int argc, char* argv[]) {
     std::cerr.tie(nullptr);
     auto args = new juce::ArgumentList(argc, argv);
     eim::args = args;
+    if (args->containsOption("--affinity")) eim::utils::setProcessAffinity(eim::utils::parseCoreList(eim::utils::getOptionValue(*args, "--affinity")));
 
     if (eim::args->containsOption("-S|--scan")) {
-        juce::AudioPluginFormatManager manager;
-        manager.addDefaultFormats();
-        auto id = args->getValueForOption("-S|--scan");
-        if (id.isEmpty()) {
-            juce::StringArray paths;
-            for (auto it : manager.getFormats()) {
-                paths.addArray(it->searchPathsForPlugins(juce::FileSearchPath(), true, true));
-            }
-            puts(juce::JSON::toString(paths, true).toRawUTF8());
-            return 0;
-        } else if (id == "#") {
-            char path[512];
-            std::cin.getline(path, 512, 0);
-            id = path;
-        }
-        juce::initialiseJuce_GUI();
-        juce::OwnedArray<juce::PluginDescription> results;
-        for (auto it : manager.getFormats()) it->findAllTypesForFile(results, id);
-
-        if (results.isEmpty()) {
-            juce::shutdownJuce_GUI();
-            return -1;
-        }
-        juce::Array<juce::var> arr;
-        for (auto it : results) {
-            auto obj = new juce::DynamicObject();
-            obj->setProperty("name", it->name);
-            obj->setProperty("descriptiveName", it->descriptiveName);
-            obj->setProperty("pluginFormatName", it->pluginFormatName);
-            obj->setProperty("category", it->category);
-            obj->setProperty("manufacturerName", it->manufacturerName);
-            obj->setProperty("version", it->version);
-            obj->setProperty("identifier", it->createIdentifierString());
-            obj->setProperty("fileOrIdentifier", it->fileOrIdentifier);
-            obj->setProperty("lastFileModTime", it->lastFileModTime.toMilliseconds());
-            obj->setProperty("lastInfoUpdateTime", it->lastInfoUpdateTime.toMilliseconds());
-            obj->setProperty("deprecatedUid", it->deprecatedUid);
-            obj->setProperty("uniqueId", it->uniqueId);
-            obj->setProperty("isInstrument", it->isInstrument);
-            obj->setProperty("hasSharedContainer", it->hasSharedContainer);
-            obj->setProperty("hasARAExtension", it->hasARAExtension);
-            arr.add(obj);
-        }
-        puts(("$EIMHostScanner{{" + juce::JSON::toString(arr, true) + "}}EIMHostScanner$").toRawUTF8());
-        juce::shutdownJuce_GUI();
+        return eim::scanner::runScan(*args);
+    } else if (args->containsOption("--scan-batch")) {
+        return eim::scanner::runScanBatch(*args);
     } else if (args->containsOption("-L|--load")) {
+        if (args->containsOption("--replay")) { // nobody reads the replies of a replayed session
+#ifdef JUCE_WINDOWS
+            juce::ignoreUnused(freopen("NUL", "w", stdout));
+#else
+            juce::ignoreUnused(freopen("/dev/null", "w", stdout));
+#endif
+        }
         eim::streams::preventStdout();
         juce::JUCEApplicationBase::createInstance = eim::plugin_host::createInstance;
         juce::JUCEApplicationBase::main(argc, (const char**)argv);
+    } else if (args->containsOption("--render")) {
+        juce::initialiseJuce_GUI();
+        auto result = eim::offline_renderer(*args).render();
+        juce::shutdownJuce_GUI();
+        return result;
     } else if (args->containsOption("-O|--output")) {
 #ifdef JUCE_WINDOWS
         juce::ignoreUnused(CoInitialize(nullptr));
@@ -107,14 +80,19 @@ int main(int argc, char* argv[]) {
         if (deviceName == "#") deviceName = eim::streams::input().readString();
         
         auto memorySize = args->getValueForOption("-MS|--memory-size");
+        auto numInputs = args->containsOption("-I|--inputs") ? eim::utils::getOptionValue(*args, "-I|--inputs").getIntValue() : 0;
+        if (args->containsOption("-I|--inputs") && numInputs <= 0) numInputs = 2;
         eim::audio_output audioCallback(deviceManager, setup, args->getValueForOption("-M|--memory"),
-            memorySize.isEmpty() ? 0 : memorySize.getIntValue());
+            memorySize.isEmpty() ? 0 : memorySize.getIntValue(), args->containsOption("-Y|--sync"),
+            args->getValueForOption("-Y|--sync").getIntValue(), args->getValueForOption("-D|--render-ahead").getIntValue(), numInputs);
         for (auto& it : deviceManager.getAvailableDeviceTypes()) {
             if (deviceType == it->getTypeName()) it->scanForDevices();
         }
         if (deviceType.isNotEmpty()) deviceManager.setCurrentAudioDeviceType(deviceType, true);
         if (deviceName.isNotEmpty() && deviceName != "#") setup.outputDeviceName = deviceName;
-        auto error = deviceManager.initialise(0, 2, nullptr, true, "", &setup);
+        auto inputDevice = eim::utils::getOptionValue(*args, "--input-device");
+        if (numInputs > 0 && inputDevice.isNotEmpty()) setup.inputDeviceName = inputDevice;
+        auto error = deviceManager.initialise(numInputs, 2, nullptr, true, "", &setup);
         if (error.isNotEmpty()) {
             eim::streams::output().writeError(error);
             juce::shutdownJuce_GUI();
@@ -0,0 +1,81 @@
+#ifndef EIM_NATIVE_BYPASS_H
+#define EIM_NATIVE_BYPASS_H
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace eim {
+    // Host-side bypass (--native-bypass): while bypassed the plugin is not called at all and the dry
+    // input comes out delayed by the plugin's latency, so the timeline stays aligned. Switching
+    // crossfades between the plugin and the dry signal over one block; when the bypass ends the plugin
+    // is reset first, so the ramp does not fade in tails and delay lines left from before it.
+    template <typename T> class native_bypass {
+    public:
+        // Allocates the delay line; only reallocates when the channel count, latency or block size changed.
+        void prepare(int channels, int latency, int blockSize) {
+            if (channels == numChannels && latency == delay && blockSize == maxBlockSize) return;
+            numChannels = channels;
+            delay = juce::jmax(0, latency);
+            maxBlockSize = blockSize;
+            ring.setSize(juce::jmax(1, channels), delay + blockSize);
+            ring.clear();
+            dry.setSize(juce::jmax(1, channels), blockSize);
+            writePos = 0;
+        }
+
+        template <typename F, typename R> void process(juce::AudioBuffer<T>& block, int numInputs, bool isBypassed, F&& processPlugin,
+                                                       R&& resetPlugin) {
+            auto numSamples = juce::jmin(block.getNumSamples(), maxBlockSize);
+            auto channels = juce::jmin(numInputs, numChannels, block.getNumChannels());
+            auto readPos = push(block, channels, numSamples);
+
+            if (!isBypassed && !wasBypassed) {
+                processPlugin();
+                return;
+            }
+            if (isBypassed && wasBypassed) {
+                read(block, channels, numSamples, readPos);
+                for (int i = channels; i < block.getNumChannels(); i++) block.clear(i, 0, numSamples);
+                return;
+            }
+
+            read(dry, channels, numSamples, readPos);
+            if (!isBypassed) resetPlugin();
+            processPlugin();
+            auto wetStart = isBypassed ? (T)1 : (T)0, wetEnd = (T)1 - wetStart;
+            for (int i = 0; i < block.getNumChannels(); i++) {
+                block.applyGainRamp(i, 0, numSamples, wetStart, wetEnd);
+                if (i < channels) block.addFromWithRamp(i, 0, dry.getReadPointer(i), numSamples, wetEnd, wetStart);
+            }
+            wasBypassed = isBypassed;
+        }
+
+    private:
+        juce::AudioBuffer<T> ring, dry;
+        int numChannels = -1, delay = -1, maxBlockSize = -1, writePos = 0;
+        bool wasBypassed = false;
+
+        // Writes the dry input into the ring and returns where its delayed counterpart starts.
+        int push(const juce::AudioBuffer<T>& block, int channels, int numSamples) {
+            auto size = ring.getNumSamples();
+            auto first = juce::jmin(numSamples, size - writePos);
+            for (int i = 0; i < channels; i++) {
+                ring.copyFrom(i, writePos, block, i, 0, first);
+                if (first < numSamples) ring.copyFrom(i, 0, block, i, first, numSamples - first);
+            }
+            auto readPos = (writePos - delay + size) % size;
+            writePos = (writePos + numSamples) % size;
+            return readPos;
+        }
+
+        void read(juce::AudioBuffer<T>& dest, int channels, int numSamples, int readPos) const {
+            auto size = ring.getNumSamples();
+            auto first = juce::jmin(numSamples, size - readPos);
+            for (int i = 0; i < channels; i++) {
+                dest.copyFrom(i, 0, ring, i, readPos, first);
+                if (first < numSamples) dest.copyFrom(i, first, ring, i, 0, numSamples - first);
+            }
+        }
+    };
+}
+
+#endif
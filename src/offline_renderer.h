@@ -0,0 +1,157 @@
+#ifndef EIM_OFFLINE_RENDERER_H
+#define EIM_OFFLINE_RENDERER_H
+
+#include <juce_audio_utils/juce_audio_utils.h>
+#include "utils.h"
+#include "plugin_chain.h"
+#include "plugin_state.h"
+
+namespace eim {
+    // Renders a plugin (or plugin chain) driven by a MIDI file and/or an input audio file straight to
+    // a WAV/FLAC file as fast as the plugin can go, without the engine in the loop.
+    class offline_renderer : public juce::AudioPlayHead {
+    public:
+        explicit offline_renderer(juce::ArgumentList& _args) : args(_args) { }
+
+        juce::Optional<juce::AudioPlayHead::PositionInfo> getPosition() const override { return positionInfo; }
+
+        int render() {
+            // Options are read with utils::getOptionValue/getOptionFile so the documented "--option value"
+            // form works; an option without a value keeps its default.
+            auto outFile = utils::getOptionFile(args, "-F|--file");
+            if (outFile == juce::File()) return fail("Missing output file (--file)");
+            auto value = utils::getOptionValue(args, "-R|--sampleRate");
+            sampleRate = value.isEmpty() ? 48000 : value.getIntValue();
+            value = utils::getOptionValue(args, "-B|--bufferSize");
+            bufferSize = value.isEmpty() ? 1024 : value.getIntValue();
+            if (sampleRate <= 0 || bufferSize <= 0) return fail("Invalid sample rate or buffer size");
+            value = utils::getOptionValue(args, "--bits");
+            auto bitDepth = value.isEmpty() ? 24 : value.getIntValue();
+            if (bitDepth != 16 && bitDepth != 24 && bitDepth != 32) return fail("Unsupported bit depth (--bits 16, 24 or 32)");
+
+            auto jsonStr = utils::getOptionValue(args, "--render");
+            if (jsonStr.isEmpty()) return fail("Missing plugin description (--render)");
+            auto json = juce::JSON::fromString(jsonStr == "#" ? streams::input().readString() : jsonStr);
+            juce::AudioPluginFormatManager manager;
+            manager.addDefaultFormats();
+            juce::String error;
+            auto processor = createPluginInstance(manager, json, sampleRate, bufferSize, error);
+            if (error.isNotEmpty() || !processor) return fail(error.isEmpty() ? "Failed to load plugin" : error);
+            processor->enableAllBuses();
+            processor->setPlayHead(this);
+            processor->setNonRealtime(true);
+
+            if (args.containsOption("-P|--preset")) {
+                plugin_state state;
+                auto preset = utils::getOptionFile(args, "-P|--preset");
+                if (preset == juce::File() || !state.read(preset)) return fail("Failed to open preset");
+                processor->setStateInformation(state.data.getData(), (int)state.data.getSize());
+            }
+
+            double length = 0, bpm = 120;
+            juce::MidiMessageSequence midi;
+            if (args.containsOption("--midi")) {
+                juce::FileInputStream stream(utils::getOptionFile(args, "--midi"));
+                juce::MidiFile midiFile;
+                if (!stream.openedOk() || !midiFile.readFrom(stream)) return fail("Failed to read MIDI file");
+                midiFile.convertTimestampTicksToSeconds();
+                for (int i = 0; i < midiFile.getNumTracks(); i++) midi.addSequence(*midiFile.getTrack(i), 0);
+                midi.sort();
+                for (auto it : midi) if (it->message.isTempoMetaEvent()) {
+                    bpm = 60.0 / it->message.getTempoSecondsPerQuarterNote();
+                    break;
+                }
+                length = midi.getEndTime();
+            }
+
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+            std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+            std::unique_ptr<juce::ResamplingAudioSource> inputSource;
+            if (args.containsOption("-I|--input")) {
+                auto input = utils::getOptionFile(args, "-I|--input");
+                auto reader = input == juce::File() ? nullptr : formats.createReaderFor(input);
+                if (!reader) return fail("Failed to read input audio file");
+                length = juce::jmax(length, (double)reader->lengthInSamples / reader->sampleRate);
+                auto readerRate = reader->sampleRate;
+                readerSource = std::make_unique<juce::AudioFormatReaderSource>(reader, true);
+                inputSource = std::make_unique<juce::ResamplingAudioSource>(readerSource.get(), false,
+                    juce::jmax(1, processor->getTotalNumInputChannels()));
+                inputSource->setResamplingRatio(readerRate / sampleRate);
+                inputSource->prepareToPlay(bufferSize, sampleRate);
+            }
+
+            value = utils::getOptionValue(args, "--tail");
+            auto tail = value.isNotEmpty() ? juce::jmax(0.0, value.getDoubleValue()) : juce::jmin(processor->getTailLengthSeconds(), 10.0);
+            auto latency = (juce::int64)processor->getLatencySamples();
+            auto totalSamples = (juce::int64)((length + tail) * sampleRate);
+
+            auto numOutputChannels = processor->getTotalNumOutputChannels();
+            std::unique_ptr<juce::AudioFormat> format;
+            if (outFile.hasFileExtension("flac")) format = std::make_unique<juce::FlacAudioFormat>();
+            else format = std::make_unique<juce::WavAudioFormat>();
+            outFile.deleteFile();
+            auto outStream = outFile.createOutputStream();
+            if (!outStream) return fail("Failed to create output file");
+            std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(outStream.get(), sampleRate,
+                (unsigned int)numOutputChannels, bitDepth, {}, 0));
+            if (!writer) return fail("Unsupported output format");
+            juce::ignoreUnused(outStream.release()); // now owned by the writer
+
+            processor->prepareToPlay(sampleRate, bufferSize);
+            juce::AudioBuffer<float> buffer(juce::jmax(processor->getTotalNumInputChannels(), numOutputChannels), bufferSize);
+            juce::MidiBuffer midiBuffer;
+            positionInfo.setIsPlaying(true);
+            positionInfo.setBpm(bpm);
+
+            auto startTime = juce::Time::getMillisecondCounterHiRes();
+            int nextEvent = 0;
+            for (juce::int64 pos = 0; pos < totalSamples + latency; pos += bufferSize) {
+                buffer.clear();
+                if (inputSource) {
+                    juce::AudioSourceChannelInfo info(&buffer, 0, bufferSize);
+                    inputSource->getNextAudioBlock(info);
+                }
+
+                midiBuffer.clear();
+                auto blockEnd = (double)(pos + bufferSize) / sampleRate;
+                for (; nextEvent < midi.getNumEvents(); nextEvent++) {
+                    auto& message = midi.getEventPointer(nextEvent)->message;
+                    if (message.getTimeStamp() >= blockEnd) break;
+                    if (message.isMetaEvent()) continue;
+                    auto offset = (int)(message.getTimeStamp() * sampleRate - (double)pos);
+                    midiBuffer.addEvent(message, juce::jlimit(0, bufferSize - 1, offset));
+                }
+
+                auto timeInSeconds = (double)pos / sampleRate;
+                positionInfo.setTimeInSamples(pos);
+                positionInfo.setTimeInSeconds(timeInSeconds);
+                positionInfo.setPpqPosition(timeInSeconds / 60.0 * bpm);
+                processor->processBlock(buffer, midiBuffer);
+
+                // Drop the first latency samples so the rendered file is aligned with the input
+                auto start = juce::jlimit((juce::int64)0, (juce::int64)bufferSize, latency - pos);
+                auto end = juce::jlimit((juce::int64)0, (juce::int64)bufferSize, totalSamples + latency - pos);
+                if (end > start) writer->writeFromAudioSampleBuffer(buffer, (int)start, (int)(end - start));
+            }
+            writer.reset();
+            processor->releaseResources();
+
+            auto elapsed = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+            std::cerr << "Rendered " << (double)totalSamples / sampleRate << "s of audio in " << elapsed << "s\n";
+            return 0;
+        }
+
+    private:
+        juce::ArgumentList& args;
+        juce::AudioPlayHead::PositionInfo positionInfo;
+        int sampleRate = 48000, bufferSize = 1024;
+
+        static int fail(const juce::String& error) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+    };
+}
+
+#endif
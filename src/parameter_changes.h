@@ -0,0 +1,77 @@
+#ifndef EIM_PARAMETER_CHANGES_H
+#define EIM_PARAMETER_CHANGES_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+
+namespace eim {
+    // Lock-free record of parameter changes reported by the plugin (from any thread), drained by the
+    // IO thread once their debounce deadline has passed. Every parameter has an atomic value and
+    // deadline slot plus a bit in a dirty bitset, so bursts neither allocate nor drop updates.
+    class parameter_changes {
+    public:
+        // Not real-time safe, call before the plugin can report changes.
+        void resize(int size) {
+            numParameters = juce::jmax(0, size);
+            numWords = (numParameters + 63) / 64;
+            values = std::make_unique<std::atomic<float>[]>((size_t)numParameters);
+            deadlines = std::make_unique<std::atomic<juce::uint32>[]>((size_t)numParameters);
+            dirty = std::make_unique<std::atomic<juce::uint64>[]>((size_t)numWords);
+            for (int i = 0; i < numParameters; i++) values[(size_t)i].store(0, std::memory_order_relaxed);
+            for (int i = 0; i < numWords; i++) dirty[(size_t)i].store(0, std::memory_order_relaxed);
+            changed.clear();
+            changed.reserve((size_t)numParameters);
+            pending.store(false);
+        }
+
+        int size() const { return numParameters; }
+        bool hasPending() const { return pending.load(); }
+
+        void set(int index, float value, juce::uint32 deadline) {
+            if (index < 0 || index >= numParameters) return;
+            values[(size_t)index].store(value, std::memory_order_relaxed);
+            deadlines[(size_t)index].store(deadline, std::memory_order_relaxed);
+            dirty[(size_t)(index >> 6)].fetch_or((juce::uint64)1 << (index & 63), std::memory_order_release);
+            pending.store(true);
+        }
+
+        float get(int index) const { return values[(size_t)index].load(std::memory_order_relaxed); }
+
+        // Collects the parameters whose deadline is before `time` and clears their dirty bits. A change
+        // racing with the scan sets its bit again and is picked up on a later call.
+        std::vector<int>& collect(juce::uint32 time) {
+            changed.clear();
+            pending.store(false);
+            auto hasWaiting = false;
+            for (int w = 0; w < numWords; w++) {
+                auto bits = dirty[(size_t)w].load(std::memory_order_acquire);
+                while (bits) {
+                    auto bit = bits & (~bits + 1);
+                    bits &= bits - 1;
+                    auto low = (juce::uint32)bit;
+                    auto index = w * 64 + (low ? juce::findHighestSetBit(low) : 32 + juce::findHighestSetBit((juce::uint32)(bit >> 32)));
+                    if ((juce::int32)(deadlines[(size_t)index].load(std::memory_order_relaxed) - time) > 0) {
+                        hasWaiting = true;
+                        continue;
+                    }
+                    dirty[(size_t)w].fetch_and(~bit, std::memory_order_acq_rel);
+                    changed.push_back(index);
+                }
+            }
+            if (hasWaiting) pending.store(true);
+            return changed;
+        }
+
+    private:
+        int numParameters = 0, numWords = 0;
+        std::unique_ptr<std::atomic<float>[]> values;
+        std::unique_ptr<std::atomic<juce::uint32>[]> deadlines;
+        std::unique_ptr<std::atomic<juce::uint64>[]> dirty;
+        std::vector<int> changed;
+        std::atomic<bool> pending { false };
+    };
+}
+
+#endif
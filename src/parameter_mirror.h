@@ -0,0 +1,43 @@
+#ifndef EIM_PARAMETER_MIRROR_H
+#define EIM_PARAMETER_MIRROR_H
+
+#include <atomic>
+#include <juce_core/juce_core.h>
+
+namespace eim {
+    // Live copy of every parameter value inside a shared memory segment, so the engine can poll them
+    // at any rate. Layout (shared with the engine): uint32 sequence @0, uint32 count @4, float values @8.
+    // The sequence is bumped after every write; the engine re-reads when it changed.
+    class parameter_mirror {
+    public:
+        static constexpr size_t HEADER_SIZE = 8;
+
+        static size_t getMemorySize(int count) { return HEADER_SIZE + sizeof(float) * (size_t)count; }
+
+        parameter_mirror(void* address, int _count) : header(static_cast<mirror_header*>(address)),
+            values(reinterpret_cast<std::atomic<float>*>(static_cast<char*>(address) + HEADER_SIZE)), count(_count) {
+            static_assert(sizeof(std::atomic<float>) == sizeof(float) && std::atomic<float>::is_always_lock_free);
+            header->count = (juce::uint32)count;
+        }
+
+        int size() const { return count; }
+
+        void set(int index, float value) {
+            if (index < 0 || index >= count) return;
+            values[index].store(value, std::memory_order_relaxed);
+            header->sequence.fetch_add(1, std::memory_order_release);
+        }
+
+    private:
+        struct mirror_header {
+            std::atomic<juce::uint32> sequence;
+            juce::uint32 count;
+        };
+
+        mirror_header* header;
+        std::atomic<float>* values;
+        int count;
+    };
+}
+
+#endif
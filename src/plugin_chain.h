@@ -0,0 +1,243 @@
+#ifndef EIM_PLUGIN_CHAIN_H
+#define EIM_PLUGIN_CHAIN_H
+
+#include <functional>
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "utils.h"
+
+namespace eim {
+    // Runs several plugins in series inside one process on top of juce::AudioProcessorGraph,
+    // so a whole insert chain costs a single process and a single block round trip.
+    class plugin_chain : public juce::AudioPluginInstance, private juce::AudioProcessorListener {
+    public:
+        explicit plugin_chain(std::vector<std::unique_ptr<juce::AudioPluginInstance>> instances)
+            : juce::AudioPluginInstance(createBuses(instances)) {
+            using io = juce::AudioProcessorGraph::AudioGraphIOProcessor;
+            auto audioIn = graph.addNode(std::make_unique<io>(io::audioInputNode));
+            auto audioOut = graph.addNode(std::make_unique<io>(io::audioOutputNode));
+            auto midiIn = graph.addNode(std::make_unique<io>(io::midiInputNode));
+            auto midiOut = graph.addNode(std::make_unique<io>(io::midiOutputNode));
+
+            auto prev = audioIn;
+            auto prevChannels = getTotalNumInputChannels();
+            for (auto& it : instances) {
+                auto instance = it.get();
+                auto node = graph.addNode(std::move(it));
+                for (int i = 0; i < juce::jmin(prevChannels, instance->getTotalNumInputChannels()); i++)
+                    graph.addConnection({ { prev->nodeID, i }, { node->nodeID, i } });
+                if (instance->acceptsMidi())
+                    graph.addConnection({ { midiIn->nodeID, juce::AudioProcessorGraph::midiChannelIndex },
+                        { node->nodeID, juce::AudioProcessorGraph::midiChannelIndex } });
+                instance->addListener(this);
+                int index = 0;
+                for (auto param : instance->getParameters())
+                    addHostedParameter(std::make_unique<parameter>(plugins.size(), index++, param));
+                plugins.add(instance);
+                prev = node;
+                prevChannels = instance->getTotalNumOutputChannels();
+            }
+            for (int i = 0; i < juce::jmin(prevChannels, getTotalNumOutputChannels()); i++)
+                graph.addConnection({ { prev->nodeID, i }, { audioOut->nodeID, i } });
+            if (plugins.getLast()->producesMidi())
+                graph.addConnection({ { prev->nodeID, juce::AudioProcessorGraph::midiChannelIndex },
+                    { midiOut->nodeID, juce::AudioProcessorGraph::midiChannelIndex } });
+            updateLatency();
+        }
+
+        ~plugin_chain() override {
+            for (auto param : getParameters()) static_cast<parameter*>(param)->detach();
+            for (auto it : plugins) it->removeListener(this);
+        }
+
+        [[nodiscard]] int getNumPlugins() const { return plugins.size(); }
+        [[nodiscard]] juce::AudioPluginInstance* getPlugin(int index) const { return plugins[index]; }
+
+        void fillInPluginDescription(juce::PluginDescription& description) const override {
+            plugins.getFirst()->fillInPluginDescription(description);
+            description.name = getName();
+            description.isInstrument = plugins.getFirst()->getPluginDescription().isInstrument;
+        }
+
+        const juce::String getName() const override {
+            juce::StringArray names;
+            for (auto it : plugins) names.add(it->getName());
+            return names.joinIntoString(" > ");
+        }
+
+        void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override {
+            graph.setPlayConfigDetails(getTotalNumInputChannels(), getTotalNumOutputChannels(), sampleRate, maximumExpectedSamplesPerBlock);
+            graph.setProcessingPrecision(getProcessingPrecision());
+            graph.prepareToPlay(sampleRate, maximumExpectedSamplesPerBlock);
+        }
+
+        // The graph hands its own play head to every node, so forward the host's.
+        void setPlayHead(juce::AudioPlayHead* newPlayHead) override {
+            juce::AudioPluginInstance::setPlayHead(newPlayHead);
+            graph.setPlayHead(newPlayHead);
+        }
+
+        void releaseResources() override { graph.releaseResources(); }
+        void reset() override { graph.reset(); }
+        void setNonRealtime(bool isNonRealtime) noexcept override {
+            juce::AudioPluginInstance::setNonRealtime(isNonRealtime);
+            graph.setNonRealtime(isNonRealtime);
+        }
+
+        void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override {
+            graph.processBlock(buffer, midiMessages);
+        }
+
+        void processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages) override {
+            graph.processBlock(buffer, midiMessages);
+        }
+
+        bool supportsDoublePrecisionProcessing() const override {
+            for (auto it : plugins) if (!it->supportsDoublePrecisionProcessing()) return false;
+            return true;
+        }
+
+        double getTailLengthSeconds() const override {
+            double tail = 0;
+            for (auto it : plugins) tail += it->getTailLengthSeconds();
+            return tail;
+        }
+
+        bool acceptsMidi() const override {
+            for (auto it : plugins) if (it->acceptsMidi()) return true;
+            return false;
+        }
+        bool producesMidi() const override { return plugins.getLast()->producesMidi(); }
+
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override { }
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String&) override { }
+
+        void getStateInformation(juce::MemoryBlock& destData) override {
+            juce::MemoryOutputStream stream(destData, false);
+            stream.writeInt(plugins.size());
+            for (auto it : plugins) {
+                juce::MemoryBlock memory;
+                it->getStateInformation(memory);
+                stream.writeInt64((juce::int64)memory.getSize());
+                stream.write(memory.getData(), memory.getSize());
+            }
+        }
+
+        void setStateInformation(const void* data, int sizeInBytes) override {
+            juce::MemoryInputStream stream(data, (size_t)sizeInBytes, false);
+            auto size = juce::jmin(stream.readInt(), plugins.size());
+            for (int i = 0; i < size && !stream.isExhausted(); i++) {
+                juce::MemoryBlock memory;
+                stream.readIntoMemoryBlock(memory, (ssize_t)stream.readInt64());
+                plugins[i]->setStateInformation(memory.getData(), (int)memory.getSize());
+            }
+        }
+
+    private:
+        class parameter : public juce::HostedAudioProcessorParameter, private juce::AudioProcessorParameter::Listener {
+        public:
+            parameter(int pluginIndex, int index, juce::AudioProcessorParameter* _inner) : inner(_inner) {
+                auto hosted = dynamic_cast<juce::HostedAudioProcessorParameter*>(inner);
+                id = juce::String(pluginIndex) + ":" + (hosted ? hosted->getParameterID() : juce::String(index));
+                inner->addListener(this);
+            }
+            ~parameter() override { detach(); }
+
+            void detach() {
+                if (inner) inner->removeListener(this);
+                inner = nullptr;
+            }
+
+            juce::String getParameterID() const override { return id; }
+            float getValue() const override { return inner ? inner->getValue() : 0; }
+            void setValue(float newValue) override { if (inner) inner->setValue(newValue); }
+            float getDefaultValue() const override { return inner ? inner->getDefaultValue() : 0; }
+            juce::String getName(int maximumStringLength) const override { return inner ? inner->getName(maximumStringLength) : juce::String(); }
+            juce::String getLabel() const override { return inner ? inner->getLabel() : juce::String(); }
+            int getNumSteps() const override { return inner ? inner->getNumSteps() : AudioProcessor::getDefaultNumParameterSteps(); }
+            bool isDiscrete() const override { return inner && inner->isDiscrete(); }
+            bool isBoolean() const override { return inner && inner->isBoolean(); }
+            juce::String getText(float normalisedValue, int maximumStringLength) const override {
+                return inner ? inner->getText(normalisedValue, maximumStringLength) : juce::String();
+            }
+            float getValueForText(const juce::String& text) const override { return inner ? inner->getValueForText(text) : 0; }
+            bool isOrientationInverted() const override { return inner && inner->isOrientationInverted(); }
+            bool isAutomatable() const override { return inner && inner->isAutomatable(); }
+            bool isMetaParameter() const override { return inner && inner->isMetaParameter(); }
+            Category getCategory() const override { return inner ? inner->getCategory() : genericParameter; }
+            juce::StringArray getAllValueStrings() const override { return inner ? inner->getAllValueStrings() : juce::StringArray(); }
+
+        private:
+            juce::AudioProcessorParameter* inner;
+            juce::String id;
+
+            void parameterValueChanged(int, float newValue) override { sendValueChangedMessageToListeners(newValue); }
+            void parameterGestureChanged(int, bool gestureIsStarting) override {
+                if (gestureIsStarting) beginChangeGesture();
+                else endChangeGesture();
+            }
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(parameter)
+        };
+
+        juce::AudioProcessorGraph graph;
+        juce::Array<juce::AudioPluginInstance*> plugins;
+
+        static BusesProperties createBuses(const std::vector<std::unique_ptr<juce::AudioPluginInstance>>& instances) {
+            BusesProperties buses;
+            auto numInputs = instances.front()->getTotalNumInputChannels();
+            auto numOutputs = instances.back()->getTotalNumOutputChannels();
+            if (numInputs > 0) buses = buses.withInput("Input", juce::AudioChannelSet::canonicalChannelSet(numInputs), true);
+            if (numOutputs > 0) buses = buses.withOutput("Output", juce::AudioChannelSet::canonicalChannelSet(numOutputs), true);
+            return buses;
+        }
+
+        void updateLatency() {
+            int latency = 0;
+            for (auto it : plugins) latency += it->getLatencySamples();
+            setLatencySamples(latency);
+        }
+
+        void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override { }
+
+        void audioProcessorChanged(juce::AudioProcessor*, const juce::AudioProcessorListener::ChangeDetails& details) override {
+            if (details.latencyChanged) updateLatency();
+            if (details.parameterInfoChanged || details.programChanged || details.nonParameterStateChanged)
+                updateHostDisplay(details.withLatencyChanged(false));
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(plugin_chain)
+    };
+
+    // Lets another executable built from these sources (the benchmark) provide built-in processors,
+    // returning nullptr for descriptions it does not handle.
+    inline std::function<std::unique_ptr<juce::AudioPluginInstance>(const juce::var&)> createBuiltInInstance;
+
+    // Creates a single plugin from a description object, or a plugin_chain from an array of them.
+    inline std::unique_ptr<juce::AudioPluginInstance> createPluginInstance(juce::AudioPluginFormatManager& manager,
+        const juce::var& json, double sampleRate, int bufferSize, juce::String& error) {
+        if (createBuiltInInstance && !json.isArray()) if (auto instance = createBuiltInInstance(json)) return instance;
+        auto arr = json.getArray();
+        if (!arr) return manager.createPluginInstance(utils::parseDescription(json), sampleRate, bufferSize, error);
+        std::vector<std::unique_ptr<juce::AudioPluginInstance>> instances;
+        for (auto& it : *arr) {
+            auto instance = createBuiltInInstance ? createBuiltInInstance(it) : nullptr;
+            if (!instance) instance = manager.createPluginInstance(utils::parseDescription(it), sampleRate, bufferSize, error);
+            if (error.isNotEmpty() || !instance) return nullptr;
+            instance->enableAllBuses();
+            instances.push_back(std::move(instance));
+        }
+        if (instances.empty()) {
+            error = "Empty plugin chain";
+            return nullptr;
+        }
+        return std::make_unique<plugin_chain>(std::move(instances));
+    }
+}
+
+#endif
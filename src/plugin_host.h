@@ -2,6 +2,14 @@
 #include <jshm.h>
 #include "utils.h"
 #include "plugin_window.h"
+#include "plugin_chain.h"
+#include "plugin_state.h"
+#include "shared_midi.h"
+#include "parameter_changes.h"
+#include "parameter_mirror.h"
+#include "realtime.h"
+#include "telemetry.h"
+#include "native_bypass.h"
 
 constexpr auto FLAGS_IS_PLAYING   = 0b0001;
 constexpr auto FLAGS_IS_LOOPING   = 0b0010;
@@ -20,8 +28,12 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
     public:
         plugin_host() : juce::AudioPlayHead(), juce::Thread("IO Thread") { }
         ~plugin_host() override {
-            delete[] prevParameterChanges;
             shm.reset();
+            streams::input().attach(nullptr);
+            streams::output().attach(nullptr);
+            commandRing.reset();
+            replyRing.reset();
+            ringShm.reset();
         }
 
         static juce::JUCEApplicationBase* createInstance() { return new plugin_host(); }
@@ -54,14 +66,8 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
         }
 
         void audioProcessorParameterChanged(juce::AudioProcessor*, int parameterIndex, float newValue) override {
-            if (!mtx.try_lock()) return;
-            auto time = juce::Time::getApproximateMillisecondCounter() + 500;
-            if (!parameterChanges.try_emplace(parameterIndex, newValue, time).second) {
-                auto& p = parameterChanges[parameterIndex];
-                p.first = newValue;
-                p.second = time;
-            }
-            mtx.unlock();
+            parameterChanges.set(parameterIndex, newValue, juce::Time::getApproximateMillisecondCounter() + 500);
+            if (auto target = parameterMirror.load(std::memory_order_acquire)) target->set(parameterIndex, newValue);
         }
 
         void audioProcessorChanged(juce::AudioProcessor*, const ChangeDetails& details) override {
@@ -70,45 +76,102 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
         }
 
     private:
-        juce::MidiBuffer midiBuffer;
-        juce::AudioBuffer<float> buffer;
-        std::unique_ptr<jshm::shared_memory> shm;
+        juce::MidiBuffer midiBuffer, batchMidiOutput;
+        std::unique_ptr<shared_midi> sharedMidi;
+        juce::AudioBuffer<float> buffer, batchBuffer, conversionBuffer;
+        juce::AudioBuffer<double> doubleBuffer, doubleBatchBuffer;
+        std::vector<float*> channelPointers;
+        std::vector<double*> doubleChannelPointers;
+        std::unique_ptr<jshm::shared_memory> shm, ringShm, mirrorShm;
+        std::unique_ptr<parameter_mirror> mirror;
+        std::atomic<parameter_mirror*> parameterMirror { nullptr };
+        std::unique_ptr<shm_ring> commandRing, replyRing;
         std::unique_ptr<plugin_window> window;
         std::unique_ptr<juce::AudioPluginInstance> processor;
+        plugin_chain* chain = nullptr;
+        int editorIndex = 0;
         juce::AudioPlayHead::PositionInfo positionInfo;
         juce::Array<juce::AudioProcessorParameter*> parameters;
-        std::unordered_map<int, std::pair<float, juce::uint32>> parameterChanges;
-        float* prevParameterChanges{};
-        int prevParameterChangesCnt = 0;
-        bool isRealtime = true, bypass = false,
+        parameter_changes parameterChanges;
+        std::vector<float> prevParameterChanges;
+        struct parameter_info {
+            juce::int8 flags;
+            int category, numSteps, numValueStrings;
+            juce::String name, label;
+        };
+        std::vector<parameter_info> parameterInfos;
+        bool isIncrementalParameters = false;
+        std::unique_ptr<telemetry::block_telemetry> blockTelemetry;
+        double waitStart = 0;
+        juce::File stateStore;
+        bool isSilenceSleepEnabled = false, isSleeping = false, isOutputSilent = false, isNativeBypass = false;
+        native_bypass<float> floatBypass;
+        native_bypass<double> doubleBypass;
+        juce::int64 silentSamples = 0, expectedPosition = -1;
+        bool wasPlaying = false;
+        static constexpr float SILENCE_THRESHOLD = 1.0e-5f; // -100 dBFS
+        std::unique_ptr<session_recorder> recorder;
+        int midiInputOffset = 0, midiCapacity = 0;
+        std::unique_ptr<session_replayer> replayer;
+        telemetry::histogram replayTimes;
+        double replayStart = 0;
+        bool isRealtime = true, bypass = false, isDoublePrecision = false, processDouble = false,
             shouldWriteInformation = false, shouldWriteLatency = false, shouldWriteBypass = false;
-        int sampleRate = 48000, bufferSize = 1024;
+        int sampleRate = 48000, bufferSize = 1024, shmSize = 0;
         int hostBufferPos = 0;
+        static constexpr int MIDI_BUFFER_SIZE = 64 * 1024;
         juce::int8 hostBuffer[8192] = {0};
-        std::mutex mtx;
+        std::mutex mtx, stateMutex;
+        std::vector<std::pair<juce::int32, bool>> finishedStateRequests;
+        std::atomic<bool> hasFinishedStateRequests { false };
+        juce::ThreadPool stateWorker { 1 }; // declared last so pending jobs finish before the members above go away
 
         void handleAsyncUpdate() override {
-            juce::PluginDescription desc;
-            auto jsonStr = args->getValueForOption("-L|--load");
+            if (args->containsOption("--replay")) {
+                auto file = utils::getOptionFile(*args, "--replay");
+                if (file != juce::File()) replayer = std::make_unique<session_replayer>(file);
+                if (!replayer || !replayer->openedOk()) {
+                    streams::output().writeError("Failed to open the session recording");
+                    quit();
+                    return;
+                }
+                streams::input().replay(replayer.get());
+            } else if (args->containsOption("--record")) {
+                auto file = utils::getOptionFile(*args, "--record");
+                if (file != juce::File()) recorder = std::make_unique<session_recorder>(file);
+                if (recorder && recorder->openedOk()) streams::input().record(recorder.get());
+                else {
+                    recorder.reset();
+                    std::cerr << "Failed to create the session recording\n";
+                }
+            }
+            auto jsonStr = utils::getOptionValue(*args, "-L|--load");
             auto json = juce::JSON::fromString(jsonStr == "#" ? streams::input().readString() : jsonStr);
-            desc.name = json.getProperty("name", "").toString();
-            desc.pluginFormatName = json.getProperty("pluginFormatName", "").toString();
-            desc.fileOrIdentifier = json.getProperty("fileOrIdentifier", "").toString();
-            desc.uniqueId = (int)json.getProperty("uniqueId", 0);
-            desc.deprecatedUid = (int)json.getProperty("deprecatedUid", 0);
 
             juce::String error;
 
             juce::AudioPluginFormatManager manager;
             manager.addDefaultFormats();
-            processor = manager.createPluginInstance(desc, sampleRate, bufferSize, error);
-            if (error.isNotEmpty()) {
+            processor = createPluginInstance(manager, json, sampleRate, bufferSize, error);
+            if (error.isNotEmpty() || !processor) {
                 streams::output().writeError(error);
                 quit();
                 return;
             }
-            prevParameterChangesCnt = processor->getParameters().size();
-            prevParameterChanges = new float[(size_t) prevParameterChangesCnt];
+            chain = dynamic_cast<plugin_chain*>(processor.get());
+            isDoublePrecision = args->containsOption("--double");
+            isIncrementalParameters = args->containsOption("--incremental-parameters");
+            stateStore = utils::getOptionFile(*args, "--state-store"); // an empty File when not given
+            isSilenceSleepEnabled = args->containsOption("--silence-sleep");
+            isNativeBypass = args->containsOption("--native-bypass");
+            if (args->containsOption("--telemetry")) {
+                auto interval = utils::getOptionValue(*args, "--telemetry").getIntValue();
+                blockTelemetry = std::make_unique<telemetry::block_telemetry>(interval > 0 ? interval : 1000);
+            }
+            processDouble = isDoublePrecision && processor->supportsDoublePrecisionProcessing();
+            if (processDouble) processor->setProcessingPrecision(juce::AudioProcessor::doublePrecision);
+            parameterChanges.resize(processor->getParameters().size());
+            prevParameterChanges.resize((size_t)parameterChanges.size());
             processor->enableAllBuses();
             processor->setPlayHead(this);
             processor->addListener(this);
@@ -126,7 +189,9 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
         }
 
         void run() override {
+            utils::applyRealtimeOptions(*args);
             juce::int8 id;
+            waitStart = replayStart = telemetry::now();
             while (!threadShouldExit() && streams::input().read(id) == 1) {
                 switch (id) {
                     case 0: { // init
@@ -136,89 +201,116 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
                         if (!mml.lockWasGained()) return;
                         auto channels = juce::jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
                         bool setInnerBuffer = true;
+                        channelPointers.resize((size_t)channels);
+                        doubleChannelPointers.resize((size_t)channels);
                         if (enabledSharedMemory) {
-                            int shmSize;
                             juce::String shmName = streams::input().readString();
                             streams::input() >> shmSize;
                             if (shmSize && shmName.isNotEmpty()) {
-                                shm.reset(jshm::shared_memory::open(shmName.toRawUTF8(), shmSize));
+                                if (replayer) shm.reset(jshm::shared_memory::create((shmName + "_replay" + juce::String(juce::Time::getHighResolutionTicks())).toRawUTF8(), shmSize));
+                                else shm.reset(jshm::shared_memory::open(shmName.toRawUTF8(), shmSize));
                                 if (shm) {
-                                    auto buffers = new float* [(unsigned long)channels];
-                                    for (int i = 0; i < channels; i++) buffers[i] = reinterpret_cast<float*>(shm->address()) + i * bufferSize;
-                                    buffer = juce::AudioBuffer<float>(buffers, channels, bufferSize);
-                                    delete[] buffers;
+                                    if (isDoublePrecision) doubleBuffer = juce::AudioBuffer<double>(getSharedMemoryBlock(doubleChannelPointers, 0), channels, bufferSize);
+                                    else buffer = juce::AudioBuffer<float>(getSharedMemoryBlock(channelPointers, 0), channels, bufferSize);
                                     setInnerBuffer = false;
                                 }
                             } else setInnerBuffer = false;
                         } else shm.reset();
-                        if (setInnerBuffer) buffer = juce::AudioBuffer<float>(channels, bufferSize);
+                        if (setInnerBuffer) {
+                            if (isDoublePrecision) doubleBuffer = juce::AudioBuffer<double>(channels, bufferSize);
+                            else buffer = juce::AudioBuffer<float>(channels, bufferSize);
+                        }
+                        if (isDoublePrecision && !processDouble) conversionBuffer.setSize(channels, bufferSize);
+                        sharedMidi.reset();
+                        midiBuffer.ensureSize(MIDI_BUFFER_SIZE);
                         processor->prepareToPlay(sampleRate, bufferSize);
+                        if (blockTelemetry) blockTelemetry->setPeriod(bufferSize, sampleRate);
+                        silentSamples = 0;
+                        isOutputSilent = false;
+                        if (isNativeBypass) prepareBypass();
                         break;
                     }
                     case 1: { // process block
+                        syncSessionSnapshot(1);
                         double bpm;
                         juce::int8 numInputChannels, numOutputChannels = 0, flags;
                         juce::int64 timeInSamples;
                         juce::int16 numMidiEvents;
+                        auto received = blockTelemetry ? telemetry::now() : 0.0;
                         streams::input() >> flags >> bpm >> numMidiEvents;
                         streams::input().readVarLong(timeInSamples);
-
-                        double timeInSeconds = (double)timeInSamples / sampleRate;
-                        auto _isRealtime = (flags & FLAGS_IS_REALTIME) != 0;
-                        if (isRealtime != _isRealtime) {
-                            processor->setNonRealtime(!_isRealtime);
-                            isRealtime = _isRealtime;
-                        }
-                        positionInfo.setIsPlaying((flags & FLAGS_IS_PLAYING) != 0);
-                        positionInfo.setIsLooping((flags & FLAGS_IS_LOOPING) != 0);
-                        positionInfo.setIsRecording((flags & FLAGS_IS_RECORDING) != 0);
-                        positionInfo.setBpm(bpm);
-                        positionInfo.setTimeInSamples(timeInSamples);
-                        positionInfo.setTimeInSeconds(timeInSeconds);
-                        positionInfo.setPpqPosition(timeInSeconds / 60.0 * bpm);
+                        setPosition(flags, bpm, timeInSamples);
 
                         if (!shm) {
                             streams::input() >> numInputChannels >> numOutputChannels;
-                            for (int i = 0; i < numInputChannels; i++)
-                                streams::input().readArray(buffer.getWritePointer(i), bufferSize);
+                            for (int i = 0; i < numInputChannels; i++) {
+                                if (isDoublePrecision) streams::input().readArray(doubleBuffer.getWritePointer(i), bufferSize);
+                                else streams::input().readArray(buffer.getWritePointer(i), bufferSize);
+                            }
                         }
-                        juce::MidiBuffer buf;
-                        for (int i = 0; i < numMidiEvents; i++) {
-                            int data;
-                            short time;
-                            streams::input().readVarInt(data);
-                            streams::input() >> time;
-                            buf.addEvent(juce::MidiMessage(data & 0xFF, (data >> 8) & 0xFF, (data >> 16) & 0xFF), time);
+                        midiBuffer.clear();
+                        readMidiEvents(midiBuffer, numMidiEvents);
+                        if (sharedMidi) sharedMidi->read(midiBuffer, 0, bufferSize);
+                        auto numParameterChanges = readParameterChanges();
+
+                        auto isSkipped = false;
+                        if (isSilenceSleepEnabled) {
+                            auto isActive = hasTransportChanged(flags, timeInSamples) || numParameterChanges > 0 || !midiBuffer.isEmpty() || !(isDoublePrecision
+                                ? isSilent(doubleBuffer, processor->getTotalNumInputChannels()) : isSilent(buffer, processor->getTotalNumInputChannels()));
+                            isSkipped = shouldSleep(isActive);
                         }
 
-                        int numParameters;
-                        streams::input().readVarInt(numParameters);
-                        
-                        for (int i = 0; i < numParameters; i++) {
-                            int pid;
-                            float value;
-                            streams::input().readVarInt(pid);
-                            streams::input() >> value;
-                            if (pid != 9999999) if (auto* param = parameters[pid]) param->setValue(value);
+                        auto processStart = blockTelemetry || replayer ? telemetry::now() : 0.0;
+                        if (isSkipped) {
+                            if (isDoublePrecision) doubleBuffer.clear();
+                            else buffer.clear();
+                        } else {
+                            if (isDoublePrecision) process(doubleBuffer, midiBuffer);
+                            else process(buffer, midiBuffer);
+                            if (isSilenceSleepEnabled) isOutputSilent = isDoublePrecision
+                                ? isSilent(doubleBuffer, processor->getTotalNumOutputChannels()) : isSilent(buffer, processor->getTotalNumOutputChannels());
                         }
+                        auto processEnd = blockTelemetry || replayer ? telemetry::now() : 0.0;
+                        if (replayer) replayTimes.record(processEnd - processStart);
+
+                        if (sharedMidi) sharedMidi->resetOutput();
+                        writeMidiOutput(midiBuffer, 0);
+                        if (blockTelemetry && blockTelemetry->isDue()) blockTelemetry->writeReport(streams::output());
+                        if (isSkipped != isSleeping) {
+                            isSleeping = isSkipped;
+                            streams::output().writeAction(11);
+                            streams::output() << isSleeping;
+                        }
+                        writeNotify(isNativeBypass && bypass);
                         
-                        processor->processBlock(buffer, buf);
-
-                        writeNotify(false);
-                        
-                        if (!shm) for (int i = 0; i < numOutputChannels; i++) streams::output().writeArray(buffer.getReadPointer(i), bufferSize);
+                        if (!shm) for (int i = 0; i < numOutputChannels; i++) {
+                            if (isDoublePrecision) streams::output().writeArray(doubleBuffer.getReadPointer(i), bufferSize);
+                            else streams::output().writeArray(buffer.getReadPointer(i), bufferSize);
+                        }
                         streams::output().flush();
+                        if (blockTelemetry) {
+                            auto end = telemetry::now();
+                            blockTelemetry->record(processStart - waitStart, processEnd - processStart, end - processEnd, end - received);
+                        }
                         break;
                     }
                     case 2: { // open control panel
-                        juce::MessageManager::callAsync([this] {
+                        juce::int8 index = 0;
+                        if (chain) streams::input() >> index;
+                        juce::MessageManager::callAsync([this, index] {
+                            auto isSamePlugin = editorIndex == index;
+                            editorIndex = index;
                             if (window == nullptr) createEditorWindow();
-                            else window.reset(nullptr);
+                            else {
+                                window.reset(nullptr);
+                                if (!isSamePlugin) createEditorWindow();
+                            }
                         });
                         break;
                     }
                     case 3: { // save state
-                        streams::output().write(saveState(streams::input().readString()));
+                        auto file = streams::input().readString();
+                        streams::output().write(!replayer && saveState(file));
                         streams::output().flush();
                         break;
                     }
@@ -226,42 +318,430 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
                         juce::MessageManagerLock mml(Thread::getCurrentThread());
                         if (!mml.lockWasGained()) return;
                         loadState(streams::input().readString());
+                        refreshParameterMirror();
                         break;
                     }
                     case 5: { // bypass state change
                         writeNotify(true);
                         break;
                     }
+                    case 6: { // move the command stream to a shared memory ring
+                        int capacity;
+                        juce::String ringName = streams::input().readString();
+                        streams::input() >> capacity;
+                        auto ok = !replayer && openCommandRing(ringName, capacity);
+                        streams::output() << ok;
+                        streams::output().flush();
+                        if (ok) {
+                            streams::input().attach(commandRing.get());
+                            streams::output().attach(replyRing.get());
+                            std::thread([] { // the pipe is only watched for the engine going away now
+                                while (std::fgetc(stdin) != EOF) { }
+                                streams::input().close();
+                                streams::output().close(); // unblocks a write waiting for ring space
+                            }).detach();
+                        }
+                        break;
+                    }
+                    case 7: { // process a batch of consecutive blocks (non-realtime rendering)
+                        if (isDoublePrecision) processBatch(doubleBatchBuffer, doubleChannelPointers);
+                        else processBatch(batchBuffer, channelPointers);
+                        break;
+                    }
+                    case 8: { // exchange MIDI through the shared memory
+                        int inputOffset, outputOffset, capacity;
+                        streams::input() >> inputOffset >> outputOffset >> capacity;
+                        auto ok = shm && capacity > 4 && inputOffset >= 0 && outputOffset >= 0 &&
+                            inputOffset + capacity <= shmSize && outputOffset + capacity <= shmSize;
+                        if (ok) {
+                            auto address = static_cast<char*>(shm->address());
+                            sharedMidi = std::make_unique<shared_midi>(address + inputOffset, address + outputOffset, capacity);
+                            midiInputOffset = inputOffset;
+                            midiCapacity = capacity;
+                            sharedMidi->resetOutput();
+                        } else sharedMidi.reset();
+                        streams::output() << ok;
+                        streams::output().flush();
+                        break;
+                    }
+                    case 9: { // page of a parameter's value strings
+                        int index, start, count;
+                        streams::input().readVarInt(index);
+                        streams::input().readVarInt(start);
+                        streams::input().readVarInt(count);
+                        juce::StringArray page;
+                        if (index >= 0 && index < parameters.size()) {
+                            auto valueStrings = parameters[index]->getAllValueStrings();
+                            start = juce::jlimit(0, valueStrings.size(), start);
+                            for (int i = start; i < juce::jmin(valueStrings.size(), start + juce::jmax(0, count)); i++) page.add(valueStrings[i]);
+                        }
+                        streams::output().writeAction(8);
+                        streams::output().writeVarInt(index);
+                        streams::output().writeVarInt(start);
+                        streams::output() << page;
+                        streams::output().flush();
+                        break;
+                    }
+                    case 10: { // mirror all parameter values into a shared memory segment
+                        int size;
+                        juce::String mirrorName = streams::input().readString();
+                        streams::input() >> size;
+                        streams::output() << openParameterMirror(mirrorName, size);
+                        streams::output().flush();
+                        break;
+                    }
+                    case 11: { // save state in the background, completion is reported with action 10
+                        juce::int32 requestId;
+                        streams::input() >> requestId;
+                        juce::String file = streams::input().readString();
+                        if (replayer) {
+                            finishStateRequest(requestId, false);
+                            break;
+                        }
+                        // Queued right away like loads, so requests on the single worker run in command order;
+                        // the job waits for the message thread to capture the state, then writes it.
+                        stateWorker.addJob([this, requestId, file] {
+                            auto state = std::make_shared<plugin_state>();
+                            auto captured = std::make_shared<juce::WaitableEvent>();
+                            juce::MessageManager::callAsync([this, state, captured] {
+                                *state = captureState();
+                                captured->signal();
+                            });
+                            while (!captured->wait(100)) {
+                                auto job = juce::ThreadPoolJob::getCurrentThreadPoolJob();
+                                if (job && job->shouldExit()) return; // shutting down
+                            }
+                            finishStateRequest(requestId, state->write(file));
+                        });
+                        break;
+                    }
+                    case 12: { // load state in the background, completion is reported with action 10
+                        juce::int32 requestId;
+                        streams::input() >> requestId;
+                        juce::String file = streams::input().readString();
+                        stateWorker.addJob([this, requestId, file] {
+                            auto state = std::make_shared<plugin_state>();
+                            if (!state->read(file)) {
+                                finishStateRequest(requestId, false);
+                                return;
+                            }
+                            juce::MessageManager::callAsync([this, requestId, state] {
+                                applyState(*state);
+                                refreshParameterMirror();
+                                finishStateRequest(requestId, true);
+                            });
+                        });
+                        break;
+                    }
+                    case 13: { // set the native bypass (--native-bypass)
+                        bool isBypassed;
+                        streams::input() >> isBypassed;
+                        if (bypass != isBypassed) {
+                            bypass = isBypassed;
+                            juce::MessageManager::callAsync([this, isBypassed] { if (window != nullptr) window->setBypass(isBypassed); });
+                        }
+                        break;
+                    }
                     default:; // unknown command
                 }
+                waitStart = telemetry::now();
             }
+            if (replayer) writeReplayReport();
+            if (recorder) recorder->flush();
             quit();
         }
 
+        // The audio shared memory is part of a session recording: the planes of the command's blocks and
+        // the MIDI input region are saved when it arrives and put back at the same point when replaying.
+        void syncSessionSnapshot(int numBlocks) {
+            if (!shm) return;
+            if (replayer) {
+                replayer->restoreSnapshot(shm->address(), (size_t)shmSize);
+                return;
+            }
+            if (!recorder) return;
+            auto blockSize = channelPointers.size() * (size_t)bufferSize * (isDoublePrecision ? sizeof(double) : sizeof(float));
+            std::vector<shm_region> regions { { 0, juce::jmin((size_t)shmSize, blockSize * (size_t)juce::jmax(0, numBlocks)) } };
+            if (sharedMidi) regions.push_back({ (size_t)midiInputOffset, (size_t)midiCapacity });
+            recorder->snapshot(shm->address(), regions);
+        }
+
+        void writeReplayReport() {
+            float summary[4];
+            replayTimes.getSummary(summary);
+            auto elapsed = (telemetry::now() - replayStart) / 1000000.0;
+            std::cerr << "Replayed " << replayTimes.getCount() << " blocks in " << elapsed << "s, processBlock (us): min "
+                << summary[0] << ", avg " << summary[1] << ", p99 " << summary[2] << ", max " << summary[3] << '\n';
+        }
+
+        [[nodiscard]] juce::AudioPluginInstance* getEditorProcessor() const {
+            if (!chain) return processor.get();
+            return chain->getPlugin(juce::jlimit(0, chain->getNumPlugins() - 1, editorIndex));
+        }
+
+        void setPosition(juce::int8 flags, double bpm, juce::int64 timeInSamples) {
+            double timeInSeconds = (double)timeInSamples / sampleRate;
+            auto _isRealtime = (flags & FLAGS_IS_REALTIME) != 0;
+            if (isRealtime != _isRealtime) {
+                processor->setNonRealtime(!_isRealtime);
+                isRealtime = _isRealtime;
+            }
+            positionInfo.setIsPlaying((flags & FLAGS_IS_PLAYING) != 0);
+            positionInfo.setIsLooping((flags & FLAGS_IS_LOOPING) != 0);
+            positionInfo.setIsRecording((flags & FLAGS_IS_RECORDING) != 0);
+            positionInfo.setBpm(bpm);
+            positionInfo.setTimeInSamples(timeInSamples);
+            positionInfo.setTimeInSeconds(timeInSeconds);
+            positionInfo.setPpqPosition(timeInSeconds / 60.0 * bpm);
+        }
+
+        void readMidiEvents(juce::MidiBuffer& buf, int numMidiEvents) {
+            for (int i = 0; i < numMidiEvents; i++) {
+                int data;
+                short time;
+                streams::input().readVarInt(data);
+                streams::input() >> time;
+                juce::uint8 bytes[] = { (juce::uint8)(data & 0xFF), (juce::uint8)((data >> 8) & 0xFF), (juce::uint8)((data >> 16) & 0xFF) };
+                buf.addEvent(bytes, juce::jlimit(1, 3, juce::MidiMessage::getMessageLengthFromFirstByte(bytes[0])), time);
+            }
+        }
+
+        // Sends the MIDI produced by the plugin back: into the shared memory region when it is set up,
+        // otherwise as action 6 (varint count, then varint sample offset, varint size and the bytes).
+        void writeMidiOutput(const juce::MidiBuffer& buf, int offset) {
+            if (sharedMidi) {
+                if (processor->producesMidi()) sharedMidi->write(buf, offset);
+                return;
+            }
+            if (!processor->producesMidi() || buf.isEmpty()) return;
+            streams::output().writeAction(6);
+            streams::output().writeVarInt(buf.getNumEvents());
+            for (const auto metadata : buf) {
+                streams::output().writeVarInt(metadata.samplePosition + offset);
+                streams::output().writeVarInt(metadata.numBytes);
+                streams::output().writeArray(metadata.data, metadata.numBytes);
+            }
+        }
+
+        template <typename T> bool isSilent(const juce::AudioBuffer<T>& block, int numChannels) const {
+            for (int i = 0; i < juce::jmin(numChannels, block.getNumChannels()); i++)
+                if (block.getMagnitude(i, 0, block.getNumSamples()) > (T)SILENCE_THRESHOLD) return false;
+            return true;
+        }
+
+        // Sleeps once the input (audio, MIDI, parameter and transport changes) has been idle for longer than the
+        // plugin's tail plus latency and the last processed output was silent. Infinite tails never sleep.
+        bool shouldSleep(bool isInputActive) {
+            if (isInputActive) {
+                silentSamples = 0;
+                return false;
+            }
+            silentSamples += bufferSize;
+            auto tail = processor->getTailLengthSeconds();
+            if (!std::isfinite(tail)) return false;
+            auto limit = (juce::int64)(tail * sampleRate) + processor->getLatencySamples() + bufferSize;
+            return isOutputSilent && silentSamples > limit;
+        }
+
+        // Starting, stopping or relocating the transport wakes plugins that make sound from it alone
+        // (step sequencers, drum machines, synced gates).
+        bool hasTransportChanged(juce::int8 flags, juce::int64 timeInSamples) {
+            auto isPlaying = (flags & FLAGS_IS_PLAYING) != 0;
+            auto hasChanged = isPlaying != wasPlaying || (isPlaying && timeInSamples != expectedPosition);
+            wasPlaying = isPlaying;
+            expectedPosition = timeInSamples + bufferSize;
+            return hasChanged;
+        }
+
+        // Consumes the changes of one block; a rejected block (isApplied false) only skips over them.
+        int readParameterChanges(bool isApplied = true) {
+            int numParameters;
+            streams::input().readVarInt(numParameters);
+
+            for (int i = 0; i < numParameters; i++) {
+                int pid;
+                float value;
+                streams::input().readVarInt(pid);
+                streams::input() >> value;
+                if (isApplied && pid != 9999999) if (auto* param = parameters[pid]) {
+                    param->setValue(value);
+                    if (mirror) mirror->set(param->getParameterIndex(), value);
+                }
+            }
+            return numParameters;
+        }
+
+        // Returns the planes of the given block inside the shared memory. Blocks are laid out one
+        // after another, each holding all channels of bufferSize samples.
+        template <typename T> T* const* getSharedMemoryBlock(std::vector<T*>& pointers, int block) {
+            auto channels = pointers.size();
+            auto base = reinterpret_cast<T*>(shm->address()) + (size_t)block * channels * (size_t)bufferSize;
+            for (size_t i = 0; i < channels; i++) pointers[i] = base + i * (size_t)bufferSize;
+            return pointers.data();
+        }
+
+        void process(juce::AudioBuffer<float>& block, juce::MidiBuffer& midi) {
+            if (!isNativeBypass) processor->processBlock(block, midi);
+            else {
+                prepareBypass();
+                floatBypass.process(block, processor->getTotalNumInputChannels(), bypass, [&] { processor->processBlock(block, midi); },
+                    [&] { processor->reset(); });
+            }
+        }
+
+        void process(juce::AudioBuffer<double>& block, juce::MidiBuffer& midi) {
+            if (!isNativeBypass) processPlugin(block, midi);
+            else {
+                prepareBypass();
+                doubleBypass.process(block, processor->getTotalNumInputChannels(), bypass, [&] { processPlugin(block, midi); },
+                    [&] { processor->reset(); });
+            }
+        }
+
+        // Only allocates when the latency, channel count or block size changed.
+        void prepareBypass() {
+            auto channels = juce::jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
+            if (isDoublePrecision) doubleBypass.prepare(channels, processor->getLatencySamples(), bufferSize);
+            else floatBypass.prepare(channels, processor->getLatencySamples(), bufferSize);
+        }
+
+        // The engine exchanges doubles; convert around plugins that only process floats.
+        void processPlugin(juce::AudioBuffer<double>& block, juce::MidiBuffer& midi) {
+            if (processDouble) {
+                processor->processBlock(block, midi);
+                return;
+            }
+            auto channels = juce::jmin(block.getNumChannels(), conversionBuffer.getNumChannels());
+            auto numSamples = block.getNumSamples();
+            for (int i = 0; i < channels; i++)
+                utils::convertSamples(block.getReadPointer(i), conversionBuffer.getWritePointer(i), numSamples);
+            juce::AudioBuffer<float> floatBlock(conversionBuffer.getArrayOfWritePointers(), channels, numSamples);
+            processor->processBlock(floatBlock, midi);
+            for (int i = 0; i < channels; i++)
+                utils::convertSamples(conversionBuffer.getReadPointer(i), block.getWritePointer(i), numSamples);
+        }
+
+        // Runs numBlocks consecutive blocks for one command: flags, bpm, timeInSamples and numBlocks, then
+        // (without shared memory) the channel counts and all input planes block after block, then for each
+        // block its MIDI events and parameter changes. The outputs are written back in the same order.
+        template <typename T> void processBatch(juce::AudioBuffer<T>& staging, std::vector<T*>& pointers) {
+            double bpm;
+            juce::int8 numInputChannels = 0, numOutputChannels = 0, flags;
+            juce::int64 timeInSamples;
+            int numBlocks;
+            streams::input() >> flags >> bpm;
+            streams::input().readVarLong(timeInSamples);
+            streams::input().readVarInt(numBlocks);
+            syncSessionSnapshot(numBlocks);
+
+            auto channels = (int)pointers.size();
+            if (!shm) streams::input() >> numInputChannels >> numOutputChannels;
+            // The header is validated before anything is applied. A batch that does not fit into the shared
+            // memory (or names more channels than the plugin has) is rejected as a whole: its stream is
+            // consumed, but no parameter changes and no block is rendered, so the engine never reads back
+            // blocks that were not rendered.
+            auto capacity = shm ? (int)((size_t)shmSize / ((size_t)channels * (size_t)bufferSize * sizeof(T))) : numBlocks;
+            auto fits = numBlocks >= 0 && numBlocks <= capacity && numInputChannels <= channels && numOutputChannels <= channels;
+            if (!shm) {
+                if (fits) staging.setSize(channels, numBlocks * bufferSize, false, false, true);
+                for (int b = 0; b < numBlocks; b++) for (int i = 0; i < numInputChannels; i++) {
+                    if (fits) streams::input().readArray(staging.getWritePointer(i, b * bufferSize), bufferSize);
+                    else streams::input().skip(bufferSize * (int)sizeof(T));
+                }
+            }
+
+            if (sharedMidi) sharedMidi->resetOutput();
+            batchMidiOutput.clear();
+            for (int b = 0; b < numBlocks; b++) {
+                juce::int16 numMidiEvents;
+                streams::input() >> numMidiEvents;
+                midiBuffer.clear();
+                readMidiEvents(midiBuffer, numMidiEvents);
+                if (sharedMidi) sharedMidi->read(midiBuffer, b * bufferSize, bufferSize);
+                readParameterChanges(fits);
+                if (!fits) continue;
+                setPosition(flags, bpm, timeInSamples + (juce::int64)b * bufferSize);
+
+                if (!shm) for (int i = 0; i < channels; i++) pointers[(size_t)i] = staging.getWritePointer(i, b * bufferSize);
+                juce::AudioBuffer<T> block(shm ? getSharedMemoryBlock(pointers, b) : pointers.data(), channels, bufferSize);
+                auto processStart = replayer ? telemetry::now() : 0.0;
+                process(block, midiBuffer);
+                if (replayer) replayTimes.record(telemetry::now() - processStart);
+                if (sharedMidi) writeMidiOutput(midiBuffer, b * bufferSize);
+                else if (processor->producesMidi()) batchMidiOutput.addEvents(midiBuffer, 0, -1, b * bufferSize);
+            }
+
+            if (!fits) streams::output().writeError("Rejected a batch of " + juce::String(numBlocks) + " blocks (room for "
+                + juce::String(capacity) + " blocks of " + juce::String(channels) + " channels)");
+            else if (!sharedMidi) writeMidiOutput(batchMidiOutput, 0);
+            writeNotify(isNativeBypass && bypass);
+            if (!shm && fits) for (int b = 0; b < numBlocks; b++) for (int i = 0; i < numOutputChannels; i++)
+                streams::output().writeArray(staging.getReadPointer(i, b * bufferSize), bufferSize);
+            streams::output().flush();
+        }
+
+        bool openCommandRing(const juce::String& name, int capacity) {
+            if (ringShm || name.isEmpty() || !shm_ring::isValidCapacity((juce::uint32)capacity)) return false;
+            auto ringSize = shm_ring::getMemorySize((juce::uint32)capacity);
+            ringShm.reset(jshm::shared_memory::open(name.toRawUTF8(), (int)ringSize * 2));
+            if (!ringShm) return false;
+            auto address = static_cast<char*>(ringShm->address());
+            commandRing = std::make_unique<shm_ring>(address, (juce::uint32)capacity);
+            replyRing = std::make_unique<shm_ring>(address + ringSize, (juce::uint32)capacity);
+            commandRing->bindEvents(name + "_command");
+            replyRing->bindEvents(name + "_reply");
+            commandRing->reset();
+            replyRing->reset();
+            return true;
+        }
+
+        // The segment stays mapped until exit since plugin threads may write to it at any time.
+        bool openParameterMirror(const juce::String& name, int size) {
+            auto count = processor->getParameters().size();
+            if (mirrorShm || name.isEmpty() || size < (int)parameter_mirror::getMemorySize(count)) return false;
+            mirrorShm.reset(jshm::shared_memory::open(name.toRawUTF8(), size));
+            if (!mirrorShm) return false;
+            mirror = std::make_unique<parameter_mirror>(mirrorShm->address(), count);
+            refreshParameterMirror();
+            parameterMirror.store(mirror.get(), std::memory_order_release);
+            return true;
+        }
+
+        void refreshParameterMirror() {
+            if (mirror) for (auto p : processor->getParameters()) mirror->set(p->getParameterIndex(), p->getValue());
+        }
+
         void createEditorWindow() {
-            if (!processor->hasEditor()) return;
-            auto component = processor->createEditorIfNeeded();
+            auto editorProcessor = getEditorProcessor();
+            if (!editorProcessor->hasEditor()) return;
+            auto component = editorProcessor->createEditorIfNeeded();
             if (!component) return;
             long long parentHandle = 0;
 #ifdef JUCE_WINDOWS
             parentHandle = args->containsOption("-H|--handle") ? args->getValueForOption("-H|--handle").getLargeIntValue() : 0;
 #endif
-            window = std::make_unique<plugin_window>("[EIMHost] " + processor->getName() + " (" +
-                processor->getPluginDescription().pluginFormatName + ")", component, window,
-                processor->wrapperType != juce::AudioProcessor::wrapperType_VST, parentHandle);
+            window = std::make_unique<plugin_window>("[EIMHost] " + editorProcessor->getName() + " (" +
+                editorProcessor->getPluginDescription().pluginFormatName + ")", component, window,
+                editorProcessor->wrapperType != juce::AudioProcessor::wrapperType_VST, parentHandle);
             window->getBypassState().addListener(this);
         }
 
         void writeNotify(bool bypassNewValue) {
-            auto hasParameterChanges = !parameterChanges.empty();
-            if ((hostBufferPos > 0 || hasParameterChanges) && mtx.try_lock()) {
-                if (hostBufferPos > 0) {
-                    streams::output().writeArray(hostBuffer, hostBufferPos);
-                    hostBufferPos = 0;
-                }
-                if (hasParameterChanges) writeAllParameterChanges();
+            if (hostBufferPos > 0 && mtx.try_lock()) {
+                streams::output().writeArray(hostBuffer, hostBufferPos);
+                hostBufferPos = 0;
                 mtx.unlock();
             }
+            if (parameterChanges.hasPending()) writeAllParameterChanges();
+            if (hasFinishedStateRequests.load() && stateMutex.try_lock()) {
+                for (auto& [requestId, isSuccess] : finishedStateRequests) {
+                    streams::output().writeAction(10);
+                    streams::output() << requestId << isSuccess;
+                }
+                finishedStateRequests.clear();
+                hasFinishedStateRequests = false;
+                stateMutex.unlock();
+            }
             
             if (shouldWriteInformation) writeInitInformation();
             if (shouldWriteLatency) {
@@ -294,104 +774,147 @@ class plugin_host : public juce::JUCEApplication, public juce::AudioPlayHead, pu
         }
 
         bool loadState(const juce::String& file) {
-            juce::FileInputStream stream(file);
-            if (!stream.openedOk()) {
+            plugin_state state;
+            if (!state.read(file)) {
                 std::cerr << "Failed to open file: " << file << '\n';
                 fflush(stderr);
                 return true;
             }
-            bool isWindowOpen = false;
-            juce::MemoryBlock memory;
-            switch (stream.readByte()) {
-                case 0:
-                    isWindowOpen = stream.readBool();
-                    plugin_window::x_ = stream.readInt();
-                    plugin_window::y_ = stream.readInt();
-                    plugin_window::width_ = stream.readInt();
-                    plugin_window::height_ = stream.readInt();
+            return applyState(state);
+        }
+
+        bool applyState(const plugin_state& state) {
+            if (state.hasWindowGeometry) {
+                plugin_window::x_ = state.x;
+                plugin_window::y_ = state.y;
+                plugin_window::width_ = state.width;
+                plugin_window::height_ = state.height;
             }
-            stream.readIntoMemoryBlock(memory);
-            processor->setStateInformation(memory.getData(), (int)memory.getSize());
-            return isWindowOpen;
+            processor->setStateInformation(state.data.getData(), (int)state.data.getSize());
+            return state.isWindowOpen;
         }
 
         bool saveState(const juce::String& file) {
             juce::MessageManagerLock mml(Thread::getCurrentThread());
             if (!mml.lockWasGained()) return false;
-            juce::MemoryBlock memory;
-            processor->getStateInformation(memory);
-            if (auto stream = juce::File(file).createOutputStream()) {
-                stream->setPosition(0);
-                stream->truncate();
-                stream->writeByte(0); // version
-                stream->writeBool(window != nullptr);
-                stream->writeInt(plugin_window::x_);
-                stream->writeInt(plugin_window::y_);
-                stream->writeInt(plugin_window::width_);
-                stream->writeInt(plugin_window::height_);
-                stream->write(memory.getData(), memory.getSize());
-                return true;
-            }
-            return false;
+            return captureState().write(file);
+        }
+
+        plugin_state captureState() {
+            plugin_state state;
+            state.store = stateStore;
+            processor->getStateInformation(state.data);
+            state.isWindowOpen = window != nullptr;
+            state.x = plugin_window::x_;
+            state.y = plugin_window::y_;
+            state.width = plugin_window::width_;
+            state.height = plugin_window::height_;
+            return state;
         }
 
+        // Called from the state worker or the message thread; the result goes out with the next block.
+        void finishStateRequest(juce::int32 requestId, bool isSuccess) {
+            std::lock_guard lock(stateMutex);
+            finishedStateRequests.emplace_back(requestId, isSuccess);
+            hasFinishedStateRequests = true;
+        }
+
+        // Action 0: int8 inputs, int8 outputs, int32 latency, varint parameter count and the parameters,
+        // then with --double a bool telling whether the plugin processes doubles natively.
         void writeInitInformation() {
             shouldWriteInformation = false;
-            parameters = processor->getParameters();
+            auto current = processor->getParameters();
+            if (isIncrementalParameters && !parameterInfos.empty() && current == parameters) {
+                writeParameterInfoChanges();
+                return;
+            }
+            parameters = current;
+            parameterInfos.clear();
             streams::output().writeAction(0);
             streams::output() << (juce::int8)processor->getTotalNumInputChannels()
                 << (juce::int8)processor->getTotalNumOutputChannels() << (juce::int32)processor->getLatencySamples();
             auto len = parameters.size();
             streams::output().writeVarInt(len);
             for (int i = 0; i < len; i++) {
-				auto p = parameters[i];
-                auto value = p->getValue();
-                prevParameterChanges[p->getParameterIndex()] = value;
-                juce::int8 flags = 0;
-                if (p->isAutomatable()) flags |= PARAMETER_IS_AUTOMATABLE;
-                if (p->isDiscrete()) flags |= PARAMETER_IS_DISCRETE;
-                if (p->isBoolean()) flags |= PARAMETER_IS_BOOLEAN;
-                if (p->isMetaParameter()) flags |= PARAMETER_IS_META;
-                if (p->isOrientationInverted()) flags |= PARAMETER_IS_ORIENTATION_INVERTED;
-                
-                streams::output() << flags << value << p->getDefaultValue() << (int)p->getCategory()
-                    << p->getNumSteps() << p->getName(64) << p->getLabel();
-
-                auto valueStrings = p->getAllValueStrings();
-                auto size = valueStrings.size();
-                if (size > 64 || size == 0 || (size == 1 && valueStrings[0].isEmpty())) streams::output().writeVarInt(0);
-                else streams::output() << valueStrings;
-				if (i > 30) streams::output().flush(); // avoid buffer overflow
+                auto info = getParameterInfo(parameters[i]);
+                writeParameterInfo(parameters[i], info);
+                if (isIncrementalParameters) parameterInfos.push_back(std::move(info));
+                if ((i & 31) == 31) streams::output().flush(); // avoid buffer overflow
             }
+            if (isDoublePrecision) streams::output() << processDouble; // trailing: whether the plugin runs 64-bit natively
             streams::output().flush();
         }
 
-        void writeAllParameterChanges() {
-            auto time = juce::Time::getApproximateMillisecondCounter();
-            std::vector<int>* toRemove = nullptr;
-            for (auto it = parameterChanges.begin(); it != parameterChanges.end();) {
-                if (it->second.second > time) {
-                    it++;
-                    continue;
-                }
-                auto id = it->first;
-                auto value = it->second.first;
-                if (prevParameterChangesCnt > id && !juce::approximatelyEqual(prevParameterChanges[id], value)) {
-                    prevParameterChanges[id] = value;
-                    if (!toRemove) toRemove = new std::vector<int>();
-                    toRemove->push_back(id);
-                }
-                parameterChanges.erase(it++);
+        // Action 7: the channel layout and latency followed by only the parameters whose metadata changed
+        // since the last action 0 or 7. Only the name, label and flags are compared: JUCE caches value
+        // strings, so they are counted again only for a changed parameter and paged in with command 9.
+        void writeParameterInfoChanges() {
+            std::vector<int> changed;
+            for (int i = 0; i < parameters.size(); i++) {
+                auto info = getParameterInfo(parameters[i], false);
+                auto& prev = parameterInfos[(size_t)i];
+                if (info.flags == prev.flags && info.name == prev.name && info.label == prev.label) continue;
+                info.numValueStrings = countValueStrings(parameters[i]);
+                prev = std::move(info);
+                changed.push_back(i);
+            }
+            streams::output().writeAction(7);
+            streams::output() << (juce::int8)processor->getTotalNumInputChannels()
+                << (juce::int8)processor->getTotalNumOutputChannels() << (juce::int32)processor->getLatencySamples();
+            streams::output().writeVarInt((int)changed.size());
+            for (size_t i = 0; i < changed.size(); i++) {
+                streams::output().writeVarInt(changed[i]);
+                writeParameterInfo(parameters[changed[i]], parameterInfos[(size_t)changed[i]]);
+                if ((i & 31) == 31) streams::output().flush();
             }
+            streams::output().flush();
+        }
 
-            if (toRemove) {
-                streams::output().writeAction(3);
-                streams::output().writeVarInt((int) toRemove->size());
-                for (auto id : *toRemove) {
-                    streams::output().writeVarInt(id);
-                    streams::output() << prevParameterChanges[id];
-                }
-                delete toRemove;
+        static parameter_info getParameterInfo(juce::AudioProcessorParameter* p, bool withValueStrings = true) {
+            parameter_info info { 0, (int)p->getCategory(), p->getNumSteps(), 0, p->getName(64), p->getLabel() };
+            if (p->isAutomatable()) info.flags |= PARAMETER_IS_AUTOMATABLE;
+            if (p->isDiscrete()) info.flags |= PARAMETER_IS_DISCRETE;
+            if (p->isBoolean()) info.flags |= PARAMETER_IS_BOOLEAN;
+            if (p->isMetaParameter()) info.flags |= PARAMETER_IS_META;
+            if (p->isOrientationInverted()) info.flags |= PARAMETER_IS_ORIENTATION_INVERTED;
+            if (withValueStrings) info.numValueStrings = countValueStrings(p);
+            return info;
+        }
+
+        static int countValueStrings(juce::AudioProcessorParameter* p) {
+            auto valueStrings = p->getAllValueStrings();
+            auto size = valueStrings.size();
+            return size == 1 && valueStrings[0].isEmpty() ? 0 : size;
+        }
+
+        // With --incremental-parameters only the number of value strings is sent, the engine pages
+        // them in with command 9 when it needs them.
+        void writeParameterInfo(juce::AudioProcessorParameter* p, const parameter_info& info) {
+            auto value = p->getValue();
+            auto index = p->getParameterIndex();
+            if (index >= 0 && index < parameterChanges.size()) prevParameterChanges[(size_t)index] = value;
+            streams::output() << info.flags << value << p->getDefaultValue() << info.category
+                << info.numSteps << info.name << info.label;
+            if (isIncrementalParameters) streams::output().writeVarInt(info.numValueStrings);
+            else if (info.numValueStrings == 0 || info.numValueStrings > 64) streams::output().writeVarInt(0);
+            else streams::output() << p->getAllValueStrings();
+        }
+
+        void writeAllParameterChanges() {
+            auto& changed = parameterChanges.collect(juce::Time::getApproximateMillisecondCounter());
+            changed.erase(std::remove_if(changed.begin(), changed.end(), [this] (int id) {
+                auto value = parameterChanges.get(id);
+                if (juce::approximatelyEqual(prevParameterChanges[(size_t)id], value)) return true;
+                prevParameterChanges[(size_t)id] = value;
+                return false;
+            }), changed.end());
+            if (changed.empty()) return;
+
+            streams::output().writeAction(3);
+            streams::output().writeVarInt((int)changed.size());
+            for (auto id : changed) {
+                streams::output().writeVarInt(id);
+                streams::output() << prevParameterChanges[(size_t)id];
             }
         }
 
@@ -0,0 +1,294 @@
+#ifndef EIM_PLUGIN_SCANNER_H
+#define EIM_PLUGIN_SCANNER_H
+
+#include <iostream>
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "scan_cache.h"
+#include "utils.h"
+
+#ifndef JUCE_WINDOWS
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+namespace eim::scanner {
+    constexpr auto RESULT_PREFIX = "$EIMHostScanner{{";
+    constexpr auto RESULT_SUFFIX = "}}EIMHostScanner$";
+
+    inline juce::var toJson(const juce::PluginDescription& it) {
+        auto obj = new juce::DynamicObject();
+        obj->setProperty("name", it.name);
+        obj->setProperty("descriptiveName", it.descriptiveName);
+        obj->setProperty("pluginFormatName", it.pluginFormatName);
+        obj->setProperty("category", it.category);
+        obj->setProperty("manufacturerName", it.manufacturerName);
+        obj->setProperty("version", it.version);
+        obj->setProperty("identifier", it.createIdentifierString());
+        obj->setProperty("fileOrIdentifier", it.fileOrIdentifier);
+        obj->setProperty("lastFileModTime", it.lastFileModTime.toMilliseconds());
+        obj->setProperty("lastInfoUpdateTime", it.lastInfoUpdateTime.toMilliseconds());
+        obj->setProperty("deprecatedUid", it.deprecatedUid);
+        obj->setProperty("uniqueId", it.uniqueId);
+        obj->setProperty("isInstrument", it.isInstrument);
+        obj->setProperty("hasSharedContainer", it.hasSharedContainer);
+        obj->setProperty("hasARAExtension", it.hasARAExtension);
+        return obj;
+    }
+
+    inline juce::var toJson(const juce::OwnedArray<juce::PluginDescription>& results) {
+        juce::Array<juce::var> arr;
+        for (auto it : results) arr.add(toJson(*it));
+        return arr;
+    }
+
+    // Compact alternative to the JSON output: a varint count followed by one record per plugin,
+    // every string varint length-prefixed, in the same field order as toJson.
+    inline void writeBinary(streams::output_stream& out, const juce::var& plugins) {
+        out.writeVarInt(plugins.size());
+        for (auto& it : *plugins.getArray()) {
+            for (auto name : { "name", "descriptiveName", "pluginFormatName", "category", "manufacturerName",
+                               "version", "identifier", "fileOrIdentifier" })
+                out << it.getProperty(name, "").toString();
+            out << (juce::int64)it.getProperty("lastFileModTime", 0) << (juce::int64)it.getProperty("lastInfoUpdateTime", 0)
+                << (juce::int32)(int)it.getProperty("deprecatedUid", 0) << (juce::int32)(int)it.getProperty("uniqueId", 0)
+                << (bool)it.getProperty("isInstrument", false) << (bool)it.getProperty("hasSharedContainer", false)
+                << (bool)it.getProperty("hasARAExtension", false);
+        }
+    }
+
+    inline void scanFile(juce::AudioPluginFormatManager& manager, const juce::String& file, juce::OwnedArray<juce::PluginDescription>& results) {
+        for (auto it : manager.getFormats()) it->findAllTypesForFile(results, file);
+    }
+
+    inline std::unique_ptr<scan_cache> openCache(const juce::ArgumentList& args) {
+        if (args.containsOption("--no-cache")) return nullptr;
+        auto file = utils::getOptionFile(args, "--cache");
+        return std::make_unique<scan_cache>(file == juce::File() ? scan_cache::getDefaultFile() : file);
+    }
+
+    // Runs a child scanner and collects its output, returning false when it did not finish in time.
+    // POSIX children lead their own process group, so a timeout also kills helper processes a plugin
+    // forked, and the pipe is read against the deadline, so helpers keeping it open cannot block us.
+    // On Windows ChildProcess stops reading once the child itself has exited.
+    inline bool runChild(const juce::StringArray& arguments, int timeoutMs, juce::String& output, int& exitCode) {
+#ifdef JUCE_WINDOWS
+        juce::ChildProcess process;
+        if (!process.start(arguments)) {
+            exitCode = -2;
+            return true;
+        }
+        std::thread reader([&] { output = process.readAllProcessOutput(); });
+        auto finished = process.waitForProcessToFinish(timeoutMs);
+        if (!finished) process.kill();
+        reader.join();
+        exitCode = (int)process.getExitCode();
+        return finished;
+#else
+        std::vector<std::string> strings;
+        for (auto& it : arguments) strings.emplace_back(it.toStdString());
+        std::vector<char*> argv;
+        for (auto& it : strings) argv.push_back(it.data());
+        argv.push_back(nullptr);
+        int fds[2];
+        exitCode = -2;
+        if (pipe(fds)) return true;
+        // Jobs fork concurrently, so keep this pipe out of sibling children; dup2 clears the flag on stdout.
+        for (auto fd : fds) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        auto pid = fork(); // nothing may allocate in the child before exec
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return true;
+        }
+        if (pid == 0) {
+            setpgid(0, 0);
+            dup2(fds[1], 1);
+            close(fds[0]);
+            close(fds[1]);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        setpgid(pid, pid); // also from here, so the group exists before any kill
+        close(fds[1]);
+
+        juce::MemoryOutputStream stream;
+        auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+        auto finished = true;
+        for (;;) {
+            auto remaining = (int)(deadline - juce::Time::getMillisecondCounter());
+            pollfd fd { fds[0], POLLIN, 0 };
+            auto ready = remaining > 0 ? poll(&fd, 1, remaining) : 0;
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) {
+                finished = false;
+                break;
+            }
+            char buf[4096];
+            auto len = read(fds[0], buf, sizeof(buf));
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) break;
+            stream.write(buf, (size_t)len);
+        }
+        close(fds[0]);
+
+        int status = 0;
+        while (finished && waitpid(pid, &status, WNOHANG) == 0) { // closed its output but may still hang
+            if ((int)(deadline - juce::Time::getMillisecondCounter()) <= 0) finished = false;
+            else juce::Thread::sleep(5);
+        }
+        if (!finished) {
+            kill(-pid, SIGKILL);
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+        }
+        output = stream.toString();
+        exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 0x100 | WTERMSIG(status);
+        return finished;
+#endif
+    }
+
+    // Scans a list of plugin files read from stdin (one path per line) with a pool of child scanner
+    // processes, so a crashing or hanging plugin only takes down its own process. One result line
+    // is printed per file as soon as its scan completes.
+    class batch_scanner {
+    public:
+        batch_scanner(int numJobs, int _timeoutMs, scan_cache* _cache, bool _isBinary)
+            : pool(juce::jmax(1, numJobs)), timeoutMs(_timeoutMs), cache(_cache), isBinary(_isBinary) { }
+
+        int run() {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                auto path = juce::String(line).trim();
+                if (path.isEmpty()) continue;
+                if (cache) {
+                    auto cached = cache->find(path);
+                    if (cached.isArray()) {
+                        writeResult(path, cached.size() ? "ok" : "empty", cached);
+                        continue;
+                    }
+                }
+                pool.addJob([this, path] { scan(path); });
+            }
+            while (pool.getNumJobs() > 0) juce::Thread::sleep(10);
+            if (cache) cache->save();
+            return 0;
+        }
+
+    private:
+        juce::ThreadPool pool;
+        int timeoutMs;
+        scan_cache* cache;
+        bool isBinary;
+        std::mutex outputMutex;
+
+        void scan(const juce::String& path) {
+            auto exe = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getFullPathName();
+            juce::String output;
+            int exitCode;
+            if (!runChild(juce::StringArray { exe, "-S", path, "--no-cache" }, timeoutMs, output, exitCode)) {
+                writeResult(path, "timeout", {});
+                return;
+            }
+            auto start = output.indexOf(RESULT_PREFIX), end = output.lastIndexOf(RESULT_SUFFIX);
+            if (start < 0 || end < start) {
+                // --scan exits with -1 when the file holds no plugin; anything else means it crashed
+                auto isEmpty = (exitCode & 0xFF) == 0xFF && exitCode < 0x100;
+                if (isEmpty && cache) cache->store(path, juce::Array<juce::var>());
+                writeResult(path, isEmpty ? "empty" : "failed", {});
+                return;
+            }
+            start += (int)strlen(RESULT_PREFIX);
+            auto plugins = juce::JSON::parse(output.substring(start, end));
+            if (cache && plugins.isArray()) cache->store(path, plugins);
+            writeResult(path, "ok", plugins);
+        }
+
+        void writeResult(const juce::String& path, const juce::String& status, const juce::var& plugins) {
+            if (isBinary) {
+                juce::int8 code = status == "ok" ? 0 : status == "empty" ? 1 : status == "failed" ? 2 : 3;
+                std::lock_guard lock(outputMutex);
+                streams::output() << path << code;
+                writeBinary(streams::output(), plugins.isArray() ? plugins : juce::var(juce::Array<juce::var>()));
+                streams::output().flush();
+                return;
+            }
+            auto obj = new juce::DynamicObject();
+            obj->setProperty("file", path);
+            obj->setProperty("status", status);
+            obj->setProperty("plugins", plugins.isArray() ? plugins : juce::var(juce::Array<juce::var>()));
+            auto text = RESULT_PREFIX + juce::JSON::toString(juce::var(obj), true) + RESULT_SUFFIX;
+            std::lock_guard lock(outputMutex);
+            std::cout << text << '\n';
+            std::cout.flush();
+        }
+    };
+
+    // --scan: prints the plugins inside one file (JSON, or binary with --binary), or the default search
+    // paths when no file is given. Exits with -1 when the file holds no plugin.
+    inline int runScan(const juce::ArgumentList& args) {
+        juce::AudioPluginFormatManager manager;
+        manager.addDefaultFormats();
+        auto id = utils::getOptionValue(args, "-S|--scan");
+        if (id.isEmpty()) {
+            juce::StringArray paths;
+            for (auto it : manager.getFormats()) {
+                paths.addArray(it->searchPathsForPlugins(juce::FileSearchPath(), true, true));
+            }
+            puts(juce::JSON::toString(paths, true).toRawUTF8());
+            return 0;
+        } else if (id == "#") {
+            char path[512];
+            std::cin.getline(path, 512, 0);
+            id = path;
+        }
+        auto isBinary = args.containsOption("--binary");
+        if (isBinary) {
+            streams::preventStdout();
+            streams::output().writeByteOrderMessage();
+        }
+        auto cache = openCache(args);
+        auto json = cache ? cache->find(id) : juce::var();
+        if (!json.isArray()) {
+            juce::initialiseJuce_GUI();
+            juce::OwnedArray<juce::PluginDescription> results;
+            scanFile(manager, id, results);
+            juce::shutdownJuce_GUI();
+            json = toJson(results);
+            if (cache) {
+                cache->store(id, json);
+                cache->save();
+            }
+        }
+
+        if (isBinary) {
+            writeBinary(streams::output(), json);
+            streams::output().flush();
+            return json.size() == 0 ? -1 : 0;
+        }
+        if (json.size() == 0) return -1;
+        puts((RESULT_PREFIX + juce::JSON::toString(json, true) + RESULT_SUFFIX).toRawUTF8());
+        return 0;
+    }
+
+    // --scan-batch: scans the files listed on stdin with crash-isolated child processes. A timeout of
+    // zero or less means the default of one minute.
+    inline int runScanBatch(const juce::ArgumentList& args) {
+        auto jobs = utils::getOptionValue(args, "-J|--jobs").getIntValue();
+        auto timeout = utils::getOptionValue(args, "--timeout").getIntValue();
+        auto isBinary = args.containsOption("--binary");
+        if (isBinary) {
+            streams::preventStdout();
+            streams::output().writeByteOrderMessage();
+        }
+        auto cache = openCache(args);
+        batch_scanner scanner(jobs > 0 ? jobs : juce::SystemStats::getNumCpus(), timeout > 0 ? timeout : 60000,
+            cache.get(), isBinary);
+        return scanner.run();
+    }
+}
+
+#endif
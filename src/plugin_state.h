@@ -0,0 +1,111 @@
+#ifndef EIM_PLUGIN_STATE_H
+#define EIM_PLUGIN_STATE_H
+
+#include <juce_core/juce_core.h>
+#include <juce_cryptography/juce_cryptography.h>
+
+namespace eim {
+    // The preset file written by saveState: a version byte, the editor window geometry and the
+    // getStateInformation blob. Version 0 stores the blob inline; version 1 (when a store directory is
+    // set) stores the path of a content-addressed store and the SHA-256 of each zlib-compressed chunk in it,
+    // so identical chunks across instances and autosaves are written once.
+    struct plugin_state {
+        static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+        bool hasWindowGeometry = false, isWindowOpen = false;
+        int x = 0, y = 0, width = 0, height = 0;
+        juce::MemoryBlock data;
+        juce::File store;
+
+        bool read(const juce::File& file) {
+            juce::FileInputStream stream(file);
+            if (!stream.openedOk()) return false;
+            auto version = stream.readByte();
+            switch (version) {
+                case 0:
+                case 1:
+                    hasWindowGeometry = true;
+                    isWindowOpen = stream.readBool();
+                    x = stream.readInt();
+                    y = stream.readInt();
+                    width = stream.readInt();
+                    height = stream.readInt();
+            }
+            if (version != 1) {
+                stream.readIntoMemoryBlock(data);
+                return true;
+            }
+            store = juce::File(stream.readString());
+            auto size = stream.readInt64();
+            auto numChunks = stream.readInt();
+            if (size < 0 || numChunks < 0) return false;
+            data.setSize((size_t)size);
+            juce::MemoryOutputStream out(data, false);
+            for (int i = 0; i < numChunks; i++) {
+                juce::MemoryBlock hash;
+                if (stream.readIntoMemoryBlock(hash, 32) != 32) return false;
+                juce::FileInputStream chunk(getChunkFile(hash));
+                if (!chunk.openedOk()) return false;
+                juce::GZIPDecompressorInputStream decompressor(chunk);
+                out.writeFromInputStream(decompressor, -1);
+            }
+            out.flush();
+            return (juce::int64)data.getSize() == size;
+        }
+
+        [[nodiscard]] bool write(const juce::File& file) const {
+            juce::MemoryOutputStream hashes;
+            if (store != juce::File()) {
+                for (size_t pos = 0; pos < data.getSize(); pos += CHUNK_SIZE) {
+                    auto chunk = static_cast<const char*>(data.getData()) + pos;
+                    auto len = juce::jmin(CHUNK_SIZE, data.getSize() - pos);
+                    auto hash = juce::SHA256(chunk, len).getRawData();
+                    if (!writeChunk(hash, chunk, len)) return false;
+                    hashes.write(hash.getData(), hash.getSize());
+                }
+            }
+            if (auto stream = file.createOutputStream()) {
+                stream->setPosition(0);
+                stream->truncate();
+                stream->writeByte(store == juce::File() ? 0 : 1); // version
+                stream->writeBool(isWindowOpen);
+                stream->writeInt(x);
+                stream->writeInt(y);
+                stream->writeInt(width);
+                stream->writeInt(height);
+                if (store == juce::File()) stream->write(data.getData(), data.getSize());
+                else {
+                    stream->writeString(store.getFullPathName());
+                    stream->writeInt64((juce::int64)data.getSize());
+                    stream->writeInt((int)(hashes.getDataSize() / 32));
+                    stream->write(hashes.getData(), hashes.getDataSize());
+                }
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        [[nodiscard]] juce::File getChunkFile(const juce::MemoryBlock& hash) const {
+            auto name = juce::String::toHexString(hash.getData(), (int)hash.getSize(), 0);
+            return store.getChildFile(name.substring(0, 2)).getChildFile(name + ".z");
+        }
+
+        // Chunks are immutable, so one that already exists is never rewritten.
+        [[nodiscard]] bool writeChunk(const juce::MemoryBlock& hash, const void* chunk, size_t len) const {
+            auto target = getChunkFile(hash);
+            if (target.existsAsFile()) return true;
+            if (!target.getParentDirectory().createDirectory()) return false;
+            juce::TemporaryFile temp(target);
+            {
+                juce::FileOutputStream out(temp.getFile());
+                if (!out.openedOk()) return false;
+                juce::GZIPCompressorOutputStream compressor(out);
+                if (!compressor.write(chunk, len)) return false;
+            }
+            return temp.overwriteTargetFileWithTemporary();
+        }
+    };
+}
+
+#endif
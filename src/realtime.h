@@ -0,0 +1,81 @@
+#ifndef EIM_REALTIME_H
+#define EIM_REALTIME_H
+
+#include <iostream>
+#include <juce_core/juce_core.h>
+#include "utils.h"
+
+#ifdef JUCE_WINDOWS
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace eim::utils {
+    // Gives the calling thread real-time scheduling: SCHED_FIFO (or SCHED_RR) with the given priority
+    // on POSIX systems, time critical priority on Windows. Returns false when the system refuses,
+    // e.g. without CAP_SYS_NICE or an RLIMIT_RTPRIO budget; the thread then keeps its old priority.
+    inline bool setRealtimeScheduling(int priority, bool isRoundRobin) {
+#ifdef JUCE_WINDOWS
+        juce::ignoreUnused(priority, isRoundRobin);
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+        auto policy = isRoundRobin ? SCHED_RR : SCHED_FIFO;
+        sched_param param {};
+        param.sched_priority = juce::jlimit(sched_get_priority_min(policy), sched_get_priority_max(policy), priority);
+        return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+#endif
+    }
+
+    // Parses a core list such as "0,2-3" into an affinity mask (cores above 31 are ignored).
+    inline juce::uint32 parseCoreList(const juce::String& cores) {
+        juce::uint32 mask = 0;
+        for (auto& it : juce::StringArray::fromTokens(cores, ",", "")) {
+            auto range = it.trim();
+            auto first = range.upToFirstOccurrenceOf("-", false, false).getIntValue();
+            auto last = range.containsChar('-') ? range.fromFirstOccurrenceOf("-", false, false).getIntValue() : first;
+            for (int i = juce::jmax(0, first); i <= juce::jmin(31, last); i++) mask |= (juce::uint32)1 << i;
+        }
+        return mask;
+    }
+
+    // Pins the whole process; on POSIX systems threads started afterwards inherit the calling thread's mask.
+    inline void setProcessAffinity(juce::uint32 mask) {
+#ifdef JUCE_WINDOWS
+        SetProcessAffinityMask(GetCurrentProcess(), (DWORD_PTR)mask);
+#else
+        juce::Thread::setCurrentThreadAffinityMask(mask);
+#endif
+    }
+
+    // --realtime [priority] and --realtime-policy <fifo|rr>, parsed once so apply() can run on an audio
+    // thread without touching the arguments or the console.
+    struct realtime_options {
+        bool isEnabled = false, isRoundRobin = false;
+        int priority = 70;
+
+        static realtime_options parse(const juce::ArgumentList& args) {
+            realtime_options options;
+            options.isEnabled = args.containsOption("--realtime");
+            auto priority = getOptionValue(args, "--realtime").getIntValue();
+            if (priority > 0) options.priority = priority;
+            options.isRoundRobin = getOptionValue(args, "--realtime-policy").equalsIgnoreCase("rr");
+            return options;
+        }
+
+        // Returns false only when real-time scheduling was requested and refused.
+        [[nodiscard]] bool apply() const { return !isEnabled || setRealtimeScheduling(priority, isRoundRobin); }
+    };
+
+    inline void warnRealtimeFailed() {
+        std::cerr << "Failed to enable real-time scheduling, running at normal priority\n";
+    }
+
+    // Applies the real-time options to the calling thread.
+    inline void applyRealtimeOptions(const juce::ArgumentList& args) {
+        if (!realtime_options::parse(args).apply()) warnRealtimeFailed();
+    }
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef EIM_RESAMPLER_H
+#define EIM_RESAMPLER_H
+
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace eim {
+    // Rational polyphase windowed-sinc resampler (--resample) with an output FIFO, converting the
+    // engine's project rate to the device rate. Each phase's taps are stored oldest-first next to a
+    // mirrored history, so every output sample is one contiguous dot product the compiler vectorizes.
+    class resampler {
+    public:
+        static constexpr int TAPS = 32, MAX_PHASES = 4096;
+
+        // Returns false when the rates cannot be expressed with at most MAX_PHASES phases.
+        bool prepare(int channels, int inputRate, int outputRate, int maxInputBlock) {
+            if (channels <= 0 || inputRate <= 0 || outputRate <= 0) return false;
+            auto divisor = std::gcd(inputRate, outputRate);
+            up = outputRate / divisor;
+            down = inputRate / divisor;
+            if (up > MAX_PHASES) return false;
+
+            // Prototype low-pass at the up-sampled rate, cut off below the lower of both Nyquist rates.
+            auto length = up * TAPS;
+            auto cutoff = 0.5 / juce::jmax(up, down) * 0.94;
+            auto center = (length - 1) * 0.5;
+            coefficients.assign((size_t)length, 0.0f);
+            for (int p = 0; p < up; p++) {
+                for (int j = 0; j < TAPS; j++) {
+                    auto index = p + (TAPS - 1 - j) * up;
+                    auto x = index - center;
+                    auto sinc = x == 0 ? 1.0 : std::sin(juce::MathConstants<double>::twoPi * cutoff * x) / (juce::MathConstants<double>::pi * x) / (2.0 * cutoff);
+                    auto window = 0.42 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * (index + 0.5) / length)
+                        + 0.08 * std::cos(2.0 * juce::MathConstants<double>::twoPi * (index + 0.5) / length); // Blackman
+                    coefficients[(size_t)(p * TAPS + j)] = (float)(2.0 * cutoff * up * sinc * window);
+                }
+            }
+
+            numChannels = channels;
+            history.setSize(channels, TAPS * 2);
+            history.clear();
+            historyPos = 0;
+            inputCount = outputPosition = 0;
+            fifo.setSize(channels, (int)((juce::int64)maxInputBlock * up / down) + 2 * maxInputBlock + 2);
+            fifo.clear();
+            numReady = 0;
+            return true;
+        }
+
+        // Delay added by the filter, in output samples.
+        [[nodiscard]] int getLatency() const { return (int)(((juce::int64)TAPS / 2 * up + down / 2) / down); }
+        [[nodiscard]] int getNumReady() const { return numReady; }
+
+        void push(const float* const* input, int numSamples) {
+            for (int i = 0; i < numSamples; i++) {
+                for (int ch = 0; ch < numChannels; ch++) {
+                    auto data = history.getWritePointer(ch);
+                    data[historyPos] = data[historyPos + TAPS] = input[ch][i];
+                }
+                historyPos = (historyPos + 1) % TAPS;
+                inputCount++;
+
+                // Every output sample whose position falls on this input sample.
+                for (; outputPosition < inputCount * up && numReady < fifo.getNumSamples(); outputPosition += down) {
+                    auto taps = coefficients.data() + (size_t)(outputPosition % up) * TAPS;
+                    for (int ch = 0; ch < numChannels; ch++) {
+                        auto window = history.getReadPointer(ch, historyPos);
+                        float sum = 0;
+                        for (int j = 0; j < TAPS; j++) sum += taps[j] * window[j];
+                        fifo.setSample(ch, numReady, sum);
+                    }
+                    numReady++;
+                }
+            }
+        }
+
+        // Moves numSamples from the FIFO into `output`, zero filling what is not ready yet.
+        void pop(float* const* output, int channels, int numSamples) {
+            auto available = juce::jmin(numSamples, numReady);
+            for (int ch = 0; ch < channels; ch++) {
+                if (ch < numChannels) juce::FloatVectorOperations::copy(output[ch], fifo.getReadPointer(ch), available);
+                else juce::FloatVectorOperations::clear(output[ch], available);
+                juce::FloatVectorOperations::clear(output[ch] + available, numSamples - available);
+            }
+            numReady -= available;
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto data = fifo.getWritePointer(ch);
+                std::memmove(data, data + available, (size_t)numReady * sizeof(float));
+            }
+        }
+
+    private:
+        std::vector<float> coefficients;
+        juce::AudioBuffer<float> history, fifo;
+        int numChannels = 0, up = 1, down = 1, historyPos = 0, numReady = 0;
+        juce::int64 inputCount = 0, outputPosition = 0;
+    };
+}
+
+#endif
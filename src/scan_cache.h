@@ -0,0 +1,102 @@
+#ifndef EIM_SCAN_CACHE_H
+#define EIM_SCAN_CACHE_H
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <juce_core/juce_core.h>
+
+namespace eim::scanner {
+    // On-disk index of previous scan results keyed by path, size and modification time, so only new
+    // or changed plugin binaries have to be instantiated again.
+    class scan_cache {
+    public:
+        explicit scan_cache(juce::File _file) : file(std::move(_file)) { read(); }
+
+        static juce::File getDefaultFile() {
+            return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                .getChildFile("EIMHost").getChildFile("scan-cache.xml");
+        }
+
+        // Returns the cached JSON array of plugins, or a void var when the file is unknown or has changed.
+        juce::var find(const juce::String& path) {
+            auto key = getKey(path);
+            std::lock_guard lock(mutex);
+            auto it = entries.find(path);
+            if (it == entries.end() || it->second.size != key.first || it->second.mtime != key.second) return {};
+            return juce::JSON::parse(it->second.json);
+        }
+
+        void store(const juce::String& path, const juce::var& plugins) {
+            auto key = getKey(path);
+            auto json = juce::JSON::toString(plugins, true);
+            std::lock_guard lock(mutex);
+            entries[path] = { key.first, key.second, json };
+            changed.insert(path);
+        }
+
+        // Several scanner processes may share the file, so the stored entries are merged into its current
+        // contents while holding an inter-process lock on it.
+        bool save() {
+            std::lock_guard lock(mutex);
+            if (changed.empty()) return true;
+            juce::InterProcessLock fileLock("EIMHostScanCache_" + juce::String::toHexString(file.getFullPathName().hashCode64()));
+            juce::InterProcessLock::ScopedLockType scopedLock(fileLock);
+            if (!scopedLock.isLocked()) return false;
+            auto ours = std::move(entries);
+            read();
+            for (auto& path : changed) entries[path] = ours[path];
+            juce::XmlElement xml("EIMHostScanCache");
+            for (auto& [path, entry] : entries) {
+                auto child = xml.createNewChildElement("FILE");
+                child->setAttribute("path", path);
+                child->setAttribute("size", juce::String(entry.size));
+                child->setAttribute("mtime", juce::String(entry.mtime));
+                child->addTextElement(entry.json);
+            }
+            file.getParentDirectory().createDirectory();
+            juce::TemporaryFile temp(file);
+            if (!xml.writeTo(temp.getFile(), juce::XmlElement::TextFormat().singleLine())) return false;
+            changed.clear();
+            return temp.overwriteTargetFileWithTemporary();
+        }
+
+    private:
+        struct entry {
+            juce::int64 size, mtime;
+            juce::String json;
+        };
+
+        juce::File file;
+        std::map<juce::String, entry> entries;
+        std::set<juce::String> changed;
+        std::mutex mutex;
+
+        void read() {
+            entries.clear();
+            if (auto xml = juce::parseXMLIfTagMatches(file, "EIMHostScanCache")) {
+                for (auto it : xml->getChildWithTagNameIterator("FILE")) {
+                    entries[it->getStringAttribute("path")] = {
+                        it->getStringAttribute("size").getLargeIntValue(),
+                        it->getStringAttribute("mtime").getLargeIntValue(),
+                        it->getAllSubText()
+                    };
+                }
+            }
+        }
+
+        // Bundles (VST3, AU, LV2) are directories, so their key covers every file inside.
+        static std::pair<juce::int64, juce::int64> getKey(const juce::String& path) {
+            juce::File f(path);
+            if (!f.isDirectory()) return { f.getSize(), f.getLastModificationTime().toMilliseconds() };
+            juce::int64 size = 0, mtime = f.getLastModificationTime().toMilliseconds();
+            for (auto& it : juce::RangedDirectoryIterator(f, true, "*", juce::File::findFiles)) {
+                size += it.getFileSize();
+                mtime = juce::jmax(mtime, it.getModificationTime().toMilliseconds());
+            }
+            return { size, mtime };
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef EIM_SESSION_RECORD_H
+#define EIM_SESSION_RECORD_H
+
+#include <cstring>
+#include <vector>
+#include <juce_core/juce_core.h>
+
+namespace eim {
+    // A recorded session (--record) is the magic "EIMREC2" followed by records of
+    // { uint8 kind, uint32 size, bytes }: kind 0 holds command stream bytes exactly as the host read
+    // them, kind 1 the regions of the audio shared memory a block command uses, as they were when it
+    // arrived, each { uint32 offset, uint32 size, bytes }.
+    constexpr char SESSION_MAGIC[] = "EIMREC2";
+    constexpr juce::uint8 SESSION_STREAM = 0, SESSION_SNAPSHOT = 1;
+
+    struct shm_region {
+        size_t offset, size;
+    };
+
+    class session_recorder {
+    public:
+        // Records go through a large file buffer, so snapshots rarely cost a disk write on the IO thread.
+        explicit session_recorder(const juce::File& file) : stream(file, 1 << 20) {
+            if (!stream.openedOk()) return;
+            stream.setPosition(0);
+            stream.truncate();
+            stream.write(SESSION_MAGIC, sizeof(SESSION_MAGIC));
+        }
+        ~session_recorder() { flush(); }
+
+        [[nodiscard]] bool openedOk() const { return stream.openedOk(); }
+
+        void append(const void* data, size_t size) {
+            pending.write(data, size);
+            if (pending.getDataSize() >= 65536) writePending();
+        }
+
+        void snapshot(const void* base, const std::vector<shm_region>& regions) {
+            writePending();
+            size_t size = 0;
+            for (auto& it : regions) size += 8 + it.size;
+            stream.writeByte((char)SESSION_SNAPSHOT);
+            stream.writeInt((int)size);
+            for (auto& it : regions) {
+                stream.writeInt((int)it.offset);
+                stream.writeInt((int)it.size);
+                stream.write(static_cast<const char*>(base) + it.offset, it.size);
+            }
+        }
+
+        void flush() {
+            writePending();
+            stream.flush();
+        }
+
+    private:
+        juce::FileOutputStream stream;
+        juce::MemoryOutputStream pending;
+
+        void writePending() {
+            if (pending.getDataSize() == 0) return;
+            writeRecord(SESSION_STREAM, pending.getData(), pending.getDataSize());
+            pending.reset();
+        }
+
+        void writeRecord(juce::uint8 kind, const void* data, size_t size) {
+            stream.writeByte((char)kind);
+            stream.writeInt((int)size);
+            stream.write(data, size);
+        }
+    };
+
+    // Feeds a recorded session back in place of the engine (--replay).
+    class session_replayer {
+    public:
+        explicit session_replayer(const juce::File& file) : input(file), stream(&input, 1 << 16, false) {
+            char magic[sizeof(SESSION_MAGIC)] = {};
+            isValid = input.openedOk() && stream.read(magic, sizeof(magic)) == (int)sizeof(magic) &&
+                std::memcmp(magic, SESSION_MAGIC, sizeof(magic)) == 0;
+        }
+
+        [[nodiscard]] bool openedOk() const { return isValid; }
+
+        // Reads command stream bytes, skipping snapshots nobody asked for.
+        size_t read(void* data, size_t size) {
+            auto out = static_cast<char*>(data);
+            size_t done = 0;
+            while (done < size) {
+                if (remaining == 0 && !nextRecord(SESSION_STREAM)) break;
+                auto len = (size_t)stream.read(out + done, (int)juce::jmin(size - done, remaining));
+                if (len == 0) break;
+                remaining -= len;
+                done += len;
+            }
+            return done;
+        }
+
+        // Copies the snapshot recorded at this point of the stream (if any) back into the `size` bytes at `data`.
+        void restoreSnapshot(void* data, size_t size) {
+            if (remaining > 0 || stream.isExhausted()) return;
+            auto position = stream.getPosition();
+            if ((juce::uint8)stream.readByte() != SESSION_SNAPSHOT) {
+                stream.setPosition(position);
+                return;
+            }
+            auto length = (juce::int64)(juce::uint32)stream.readInt();
+            auto end = stream.getPosition() + length;
+            while (stream.getPosition() + 8 <= end) {
+                auto offset = (size_t)(juce::uint32)stream.readInt();
+                auto regionSize = (size_t)(juce::uint32)stream.readInt();
+                if (offset + regionSize > size) break;
+                stream.read(static_cast<char*>(data) + offset, (int)regionSize);
+            }
+            stream.setPosition(end);
+        }
+
+    private:
+        juce::FileInputStream input;
+        juce::BufferedInputStream stream;
+        size_t remaining = 0;
+        bool isValid = false;
+
+        bool nextRecord(juce::uint8 kind) {
+            while (!stream.isExhausted()) {
+                auto recordKind = (juce::uint8)stream.readByte();
+                auto length = (size_t)(juce::uint32)stream.readInt();
+                if (recordKind == kind) {
+                    remaining = length;
+                    if (remaining > 0) return true;
+                } else stream.skipNextBytes((juce::int64)length);
+            }
+            return false;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef EIM_SHARED_MIDI_H
+#define EIM_SHARED_MIDI_H
+
+#include <cstring>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace eim {
+    // Packed MIDI event lists inside the shared memory segment, one region per direction. A region is
+    // a uint32 byte count followed by events of { int32 sampleOffset, uint16 size, uint8 data[size] },
+    // so sysex and other long messages travel without any per-event allocation.
+    class shared_midi {
+    public:
+        static constexpr int EVENT_HEADER_SIZE = 6;
+
+        shared_midi(char* _input, char* _output, int _capacity) : input(_input), output(_output), capacity(_capacity) { }
+
+        // Adds the input events in [startSample, startSample + numSamples) to `buf`, relative to startSample.
+        void read(juce::MidiBuffer& buf, int startSample, int numSamples) const {
+            juce::uint32 used;
+            std::memcpy(&used, input, sizeof(used));
+            auto end = juce::jmin((int)used, capacity - 4);
+            for (int pos = 0; pos + EVENT_HEADER_SIZE <= end;) {
+                juce::int32 time;
+                juce::uint16 size;
+                std::memcpy(&time, input + 4 + pos, sizeof(time));
+                std::memcpy(&size, input + 4 + pos + 4, sizeof(size));
+                auto data = input + 4 + pos + EVENT_HEADER_SIZE;
+                pos += EVENT_HEADER_SIZE + size;
+                if (pos > end) break;
+                if (time >= startSample && time < startSample + numSamples) buf.addEvent(data, size, time - startSample);
+            }
+        }
+
+        void resetOutput() {
+            outputUsed = 0;
+            std::memset(output, 0, 4);
+        }
+
+        // Appends `buf` to the output region with its timestamps shifted by `offset`; events that do not
+        // fit or are longer than 65535 bytes are dropped.
+        void write(const juce::MidiBuffer& buf, int offset) {
+            for (const auto metadata : buf) {
+                auto size = metadata.numBytes;
+                if (size > 0xFFFF) continue; // longer than the uint16 size field can describe
+                if (4 + outputUsed + EVENT_HEADER_SIZE + size > capacity) break;
+                auto time = (juce::int32)(metadata.samplePosition + offset);
+                auto size16 = (juce::uint16)size;
+                auto dest = output + 4 + outputUsed;
+                std::memcpy(dest, &time, sizeof(time));
+                std::memcpy(dest + 4, &size16, sizeof(size16));
+                std::memcpy(dest + EVENT_HEADER_SIZE, metadata.data, (size_t)size);
+                outputUsed += EVENT_HEADER_SIZE + size;
+            }
+            auto used = (juce::uint32)outputUsed;
+            std::memcpy(output, &used, sizeof(used));
+        }
+
+    private:
+        char* input;
+        char* output;
+        int capacity, outputUsed = 0;
+    };
+}
+
+#endif
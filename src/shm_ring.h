@@ -0,0 +1,134 @@
+#ifndef EIM_SHM_RING_H
+#define EIM_SHM_RING_H
+
+#include <cstring>
+#include "shm_sync.h"
+
+namespace eim {
+    // Lock-free single-producer single-consumer byte ring placed inside a shared memory segment.
+    // Layout (shared with the engine): head @0, tail @64, capacity/closed/waiting flags @128, data @192.
+    // head and tail are free-running byte counters; capacity must be a power of two.
+    class shm_ring {
+    public:
+        static constexpr size_t HEADER_SIZE = 192;
+
+        static size_t getMemorySize(juce::uint32 capacity) { return HEADER_SIZE + capacity; }
+
+        shm_ring(void* address, juce::uint32 _capacity) : header(static_cast<ring_header*>(address)),
+            data(static_cast<char*>(address) + HEADER_SIZE), capacity(_capacity), mask(_capacity - 1) { }
+        ~shm_ring() { sync::unbindEvents(header, HEADER_SIZE); }
+
+        // Names the events the ring's counters are signalled through where the platform needs them.
+        void bindEvents(const juce::String& name) {
+            sync::bindEvent(header->head, name + "_head");
+            sync::bindEvent(header->tail, name + "_tail");
+        }
+
+        static bool isValidCapacity(juce::uint32 capacity) { return capacity >= 64 && juce::isPowerOfTwo(capacity); }
+
+        void reset() {
+            header->head.store(0);
+            header->tail.store(0);
+            header->capacity = capacity;
+            header->closed.store(0);
+            header->producerWaiting.store(0);
+            header->consumerWaiting.store(0);
+            pending = 0;
+        }
+
+        [[nodiscard]] bool isClosed() const { return header->closed.load(std::memory_order_acquire) != 0; }
+        void close() {
+            header->closed.store(1);
+            sync::wake(header->head);
+            sync::wake(header->tail);
+        }
+
+        // Copies up to `size` bytes out of the ring, waiting at most `timeoutMs` for the producer.
+        size_t read(void* dest, size_t size, int timeoutMs) {
+            auto out = static_cast<char*>(dest);
+            size_t done = 0;
+            auto deadline = sync::clock::now() + std::chrono::milliseconds(timeoutMs);
+            while (done < size) {
+                auto tail = header->tail.load(std::memory_order_relaxed);
+                auto head = header->head.load(std::memory_order_acquire);
+                if (head == tail) {
+                    if (isClosed()) break;
+                    header->consumerWaiting.store(1);
+                    auto ok = header->head.load() != tail || sync::waitUntil(header->head, tail, deadline);
+                    header->consumerWaiting.store(0);
+                    if (!ok) break;
+                    continue;
+                }
+                auto len = juce::jmin((size_t)(head - tail), size - done);
+                copyOut(out + done, tail, len);
+                header->tail.store(tail + (juce::uint32)len, std::memory_order_release);
+                if (header->producerWaiting.load()) sync::wake(header->tail);
+                done += len;
+            }
+            return done;
+        }
+
+        // Appends bytes without publishing them; the consumer sees them after flush(). Waits at most
+        // `timeoutMs` for free space when the ring is full.
+        size_t write(const void* src, size_t size, int timeoutMs) {
+            auto in = static_cast<const char*>(src);
+            size_t done = 0;
+            auto deadline = sync::clock::now() + std::chrono::milliseconds(timeoutMs);
+            while (done < size) {
+                auto tail = header->tail.load(std::memory_order_acquire);
+                auto free = capacity - (pending - tail);
+                if (free == 0) {
+                    if (isClosed()) break;
+                    flush();
+                    header->producerWaiting.store(1);
+                    auto ok = header->tail.load() != tail || sync::waitUntil(header->tail, tail, deadline);
+                    header->producerWaiting.store(0);
+                    if (!ok) break;
+                    continue;
+                }
+                auto len = juce::jmin((size_t)free, size - done);
+                copyIn(in + done, pending, len);
+                pending += (juce::uint32)len;
+                done += len;
+            }
+            return done;
+        }
+
+        void flush() {
+            if (header->head.load(std::memory_order_relaxed) == pending) return;
+            header->head.store(pending);
+            if (header->consumerWaiting.load()) sync::wake(header->head);
+        }
+
+    private:
+        struct ring_header {
+            alignas(64) std::atomic<juce::uint32> head;
+            alignas(64) std::atomic<juce::uint32> tail;
+            alignas(64) juce::uint32 capacity;
+            std::atomic<juce::uint32> closed, producerWaiting, consumerWaiting;
+        };
+        static_assert(sizeof(ring_header) <= HEADER_SIZE);
+
+        ring_header* header;
+        char* data;
+        juce::uint32 capacity, mask, pending = 0;
+
+        void copyOut(char* dest, juce::uint32 position, size_t len) const {
+            auto offset = position & mask;
+            auto first = juce::jmin(len, (size_t)(capacity - offset));
+            std::memcpy(dest, data + offset, first);
+            if (first < len) std::memcpy(dest + first, data, len - first);
+        }
+
+        void copyIn(const char* src, juce::uint32 position, size_t len) {
+            auto offset = position & mask;
+            auto first = juce::jmin(len, (size_t)(capacity - offset));
+            std::memcpy(data + offset, src, first);
+            if (first < len) std::memcpy(data, src + first, len - first);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE(shm_ring) // the destructor releases the header's events
+    };
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef EIM_SHM_SYNC_H
+#define EIM_SHM_SYNC_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <juce_core/juce_core.h>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#elif defined(JUCE_WINDOWS)
+#include <array>
+#include <Windows.h>
+#include <timeapi.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#elif defined(__APPLE__) && __has_include(<os/os_sync_wait_on_address.h>)
+#include <os/os_sync_wait_on_address.h>
+#define EIM_OS_SYNC_WAIT 1
+#endif
+
+namespace eim::sync {
+    using clock = std::chrono::steady_clock;
+
+    static_assert(std::atomic<juce::uint32>::is_always_lock_free && sizeof(std::atomic<juce::uint32>) == 4,
+        "Shared memory words must be plain 32-bit integers");
+
+#ifdef JUCE_WINDOWS
+    namespace detail {
+        struct event_binding {
+            std::atomic<const void*> word { nullptr };
+            HANDLE handle = nullptr;
+        };
+        inline std::array<event_binding, 32> eventBindings;
+        inline std::atomic<int> numEventBindings { 0 };
+
+        inline HANDLE findEvent(const void* word) {
+            auto count = numEventBindings.load(std::memory_order_acquire);
+            for (int i = 0; i < count; i++) if (eventBindings[(size_t)i].word.load(std::memory_order_relaxed) == word)
+                return eventBindings[(size_t)i].handle;
+            return nullptr;
+        }
+
+        // A high-resolution waitable timer per waiting thread (Windows 10 1803+), so an event wait ends
+        // within microseconds of its deadline. Null on older systems, which raise the timer resolution
+        // to 1 ms instead.
+        inline HANDLE getDeadlineTimer() {
+            thread_local struct deadline_timer {
+                HANDLE handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+                ~deadline_timer() { if (handle) CloseHandle(handle); }
+            } timer;
+            if (!timer.handle) {
+                static const auto isRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+                juce::ignoreUnused(isRaised);
+            }
+            return timer.handle;
+        }
+    }
+#endif
+
+    // Windows has no cross-process address wait, so every shared word that is waited on gets a named
+    // auto-reset event ("Local\\<name>") that both sides create and signal after changing the word.
+    // Must be called before the word is used; a no-op elsewhere.
+    inline void bindEvent(std::atomic<juce::uint32>& word, const juce::String& name) {
+#ifdef JUCE_WINDOWS
+        auto handle = CreateEventW(nullptr, FALSE, FALSE, ("Local\\" + name).toWideCharPointer());
+        if (!handle) return;
+        auto count = detail::numEventBindings.load(std::memory_order_acquire);
+        detail::event_binding* unused = nullptr;
+        for (int i = 0; i < count; i++) {
+            auto& it = detail::eventBindings[(size_t)i];
+            auto bound = it.word.load();
+            if (!bound && !unused) unused = &it;
+            if (bound != &word) continue;
+            CloseHandle(it.handle);
+            it.handle = handle;
+            return;
+        }
+        if (unused) { // a slot released by unbindEvents
+            unused->handle = handle;
+            unused->word.store(&word);
+            return;
+        }
+        if (count == (int)detail::eventBindings.size()) {
+            CloseHandle(handle);
+            return;
+        }
+        detail::eventBindings[(size_t)count].handle = handle;
+        detail::eventBindings[(size_t)count].word.store(&word);
+        detail::numEventBindings.store(count + 1, std::memory_order_release);
+#else
+        juce::ignoreUnused(word, name);
+#endif
+    }
+
+    // Releases the events of every word inside [memory, memory + size). Must be called before that
+    // mapping goes away, so remapping a segment reuses the slots instead of filling the table.
+    inline void unbindEvents(const void* memory, size_t size) {
+#ifdef JUCE_WINDOWS
+        auto begin = static_cast<const char*>(memory);
+        auto count = detail::numEventBindings.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            auto& it = detail::eventBindings[(size_t)i];
+            auto word = static_cast<const char*>(it.word.load());
+            if (!word || word < begin || word >= begin + size) continue;
+            it.word.store(nullptr);
+            CloseHandle(it.handle);
+            it.handle = nullptr;
+        }
+#else
+        juce::ignoreUnused(memory, size);
+#endif
+    }
+
+    // Blocks until `word` no longer holds `expected` or the deadline passes. Linux uses a
+    // process-shared futex on the word inside the mapped segment and macOS its shared address wait.
+    // Windows waits on the word's named event together with a high-resolution timer set to the
+    // deadline (or, without one, with a 1 ms timeout resolution, spinning only the last millisecond);
+    // a word without an event is spun. Other platforms poll with short sleeps.
+    inline bool waitUntil(std::atomic<juce::uint32>& word, juce::uint32 expected, clock::time_point deadline) {
+#ifdef JUCE_WINDOWS
+        auto event = detail::findEvent(&word);
+#endif
+        while (word.load(std::memory_order_acquire) == expected) {
+            auto remaining = deadline - clock::now();
+            if (remaining <= clock::duration::zero()) return false;
+#ifdef __linux__
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+            timespec timeout{ (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+            syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#elif defined(JUCE_WINDOWS)
+            auto timer = event ? detail::getDeadlineTimer() : nullptr;
+            if (timer) {
+                LARGE_INTEGER due; // relative, in 100 ns units
+                due.QuadPart = -juce::jmax<juce::int64>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count() / 100);
+                SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE);
+                HANDLE handles[] { event, timer };
+                WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+            } else {
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count() - 1;
+                if (event && ms > 0) WaitForSingleObject(event, (DWORD)juce::jmin<juce::int64>(ms, INFINITE - 1));
+                else std::this_thread::yield();
+            }
+#elif defined(EIM_OS_SYNC_WAIT)
+            if (__builtin_available(macOS 14.4, *)) {
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+                os_sync_wait_on_address_with_timeout(&word, expected, sizeof(juce::uint32), OS_SYNC_WAIT_ON_ADDRESS_SHARED,
+                    OS_CLOCK_MACH_ABSOLUTE_TIME, (uint64_t)ns);
+            } else std::this_thread::sleep_for(juce::jmin<clock::duration>(remaining, std::chrono::microseconds(50)));
+#else
+            std::this_thread::sleep_for(juce::jmin<clock::duration>(remaining, std::chrono::microseconds(50)));
+#endif
+        }
+        return true;
+    }
+
+    inline bool waitFor(std::atomic<juce::uint32>& word, juce::uint32 expected, int timeoutMs) {
+        return waitUntil(word, expected, clock::now() + std::chrono::milliseconds(timeoutMs));
+    }
+
+    inline void wake(std::atomic<juce::uint32>& word) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#elif defined(JUCE_WINDOWS)
+        if (auto event = detail::findEvent(&word)) SetEvent(event);
+#elif defined(EIM_OS_SYNC_WAIT)
+        if (__builtin_available(macOS 14.4, *)) os_sync_wake_by_address_all(&word, sizeof(juce::uint32), OS_SYNC_WAKE_BY_ADDRESS_SHARED);
+#else
+        juce::ignoreUnused(word);
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef EIM_TELEMETRY_H
+#define EIM_TELEMETRY_H
+
+#include <array>
+#include <cmath>
+#include <juce_core/juce_core.h>
+#include "utils.h"
+
+namespace eim::telemetry {
+    // Fixed log-scaled histogram of durations in microseconds (8 buckets per octave up to ~2^32 µs),
+    // cheap enough to feed from the processing thread on every block.
+    class histogram {
+    public:
+        void record(double micros) {
+            micros = juce::jmax(0.0, micros);
+            if (count == 0 || micros < min) min = micros;
+            if (micros > max) max = micros;
+            sum += micros;
+            count++;
+            buckets[(size_t)juce::jlimit(0, NUM_BUCKETS - 1, (int)(std::log2(micros + 1.0) * BUCKETS_PER_OCTAVE))]++;
+        }
+
+        void reset() { *this = {}; }
+        [[nodiscard]] juce::uint32 getCount() const { return count; }
+
+        [[nodiscard]] double getPercentile(double fraction) const {
+            auto target = (juce::uint32)std::ceil(fraction * count);
+            juce::uint32 seen = 0;
+            for (int i = 0; i < NUM_BUCKETS; i++) {
+                seen += buckets[(size_t)i];
+                if (seen >= target && seen > 0) return juce::jmin(max, std::exp2((i + 1.0) / BUCKETS_PER_OCTAVE) - 1.0);
+            }
+            return max;
+        }
+
+        // min, avg, p99 and max
+        void getSummary(float* out) const {
+            out[0] = (float)min;
+            out[1] = (float)(count ? sum / count : 0.0);
+            out[2] = (float)getPercentile(0.99);
+            out[3] = (float)max;
+        }
+
+        void write(streams::output_stream& out) const {
+            float summary[4];
+            getSummary(summary);
+            out << summary[0] << summary[1] << summary[2] << summary[3];
+        }
+
+    private:
+        static constexpr int BUCKETS_PER_OCTAVE = 8, NUM_BUCKETS = 32 * BUCKETS_PER_OCTAVE;
+        std::array<juce::uint32, NUM_BUCKETS> buckets{};
+        double min = 0, max = 0, sum = 0;
+        juce::uint32 count = 0;
+    };
+
+    inline double now() { return juce::Time::getMillisecondCounterHiRes() * 1000.0; }
+
+    // Per-block timings of the plugin host: waiting for the block request, processBlock and writing
+    // the reply, plus the blocks whose handling took longer than the buffer period.
+    class block_telemetry {
+    public:
+        explicit block_telemetry(int _intervalMs) : intervalMs(juce::jmax(1, _intervalMs)) { }
+
+        void setPeriod(int bufferSize, int sampleRate) { periodMicros = 1000000.0 * bufferSize / juce::jmax(1, sampleRate); }
+
+        void record(double waitMicros, double processMicros, double writeMicros, double handlingMicros) {
+            wait.record(waitMicros);
+            process.record(processMicros);
+            write.record(writeMicros);
+            numBlocks++;
+            if (handlingMicros > periodMicros) deadlineMisses++;
+        }
+
+        [[nodiscard]] bool isDue() const {
+            return numBlocks > 0 && juce::Time::getMillisecondCounterHiRes() - lastReport >= intervalMs;
+        }
+
+        // Action 9: int32 blocks, int32 deadline misses, float period (µs), then the wait, process and
+        // write histograms.
+        void writeReport(streams::output_stream& out) {
+            out.writeAction(9);
+            out << (juce::int32)numBlocks << (juce::int32)deadlineMisses << (float)periodMicros;
+            wait.write(out);
+            process.write(out);
+            write.write(out);
+            wait.reset();
+            process.reset();
+            write.reset();
+            numBlocks = deadlineMisses = 0;
+            lastReport = juce::Time::getMillisecondCounterHiRes();
+        }
+
+    private:
+        histogram wait, process, write;
+        int intervalMs, numBlocks = 0, deadlineMisses = 0;
+        double periodMicros = 0, lastReport = juce::Time::getMillisecondCounterHiRes();
+    };
+
+    // Device callback timings of the audio output: how long the engine took from the block request to
+    // its response, how far each callback interval deviated from the buffer period (jitter) and how
+    // many blocks were answered after the deadline.
+    class callback_telemetry {
+    public:
+        struct summary {
+            juce::uint32 numCallbacks, lateResponses;
+            float periodMicros, response[4], jitter[4];
+        };
+
+        explicit callback_telemetry(int _intervalMs) : intervalMs(juce::jmax(1, _intervalMs)) { }
+
+        void setPeriod(double micros) {
+            periodMicros = micros;
+            lastCallback = 0;
+        }
+
+        void recordCallback(double timeMicros) {
+            if (lastCallback > 0) jitter.record(std::abs(timeMicros - lastCallback - periodMicros));
+            lastCallback = timeMicros;
+            numCallbacks++;
+        }
+
+        void recordResponse(double micros, bool isLate) {
+            response.record(micros);
+            if (isLate) lateResponses++;
+        }
+
+        [[nodiscard]] bool isDue() const {
+            return numCallbacks > 0 && juce::Time::getMillisecondCounterHiRes() - lastReport >= intervalMs;
+        }
+
+        summary takeSummary() {
+            summary result { numCallbacks, lateResponses, (float)periodMicros, {}, {} };
+            response.getSummary(result.response);
+            jitter.getSummary(result.jitter);
+            response.reset();
+            jitter.reset();
+            numCallbacks = lateResponses = 0;
+            lastReport = juce::Time::getMillisecondCounterHiRes();
+            return result;
+        }
+
+        // Action 2: int32 callbacks, int32 late responses, float period (µs), then the response time
+        // and jitter histograms.
+        void writeReport(streams::output_stream& out) {
+            auto result = takeSummary();
+            out.writeAction(2);
+            out << (juce::int32)result.numCallbacks << (juce::int32)result.lateResponses << result.periodMicros;
+            for (auto it : result.response) out << it;
+            for (auto it : result.jitter) out << it;
+        }
+
+    private:
+        histogram response, jitter;
+        int intervalMs;
+        juce::uint32 numCallbacks = 0, lateResponses = 0;
+        double periodMicros = 0, lastCallback = 0, lastReport = juce::Time::getMillisecondCounterHiRes();
+    };
+}
+
+#endif
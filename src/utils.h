@@ -11,10 +11,48 @@
 #include <fcntl.h>
 #include <cstdio>
 #include <juce_audio_utils/juce_audio_utils.h>
+#include "shm_ring.h"
+#include "session_record.h"
 
 namespace eim {
     juce::ArgumentList* args;
     namespace utils {
+        inline juce::PluginDescription parseDescription(const juce::var& json) {
+            juce::PluginDescription desc;
+            desc.name = json.getProperty("name", "").toString();
+            desc.pluginFormatName = json.getProperty("pluginFormatName", "").toString();
+            desc.fileOrIdentifier = json.getProperty("fileOrIdentifier", "").toString();
+            desc.uniqueId = (int)json.getProperty("uniqueId", 0);
+            desc.deprecatedUid = (int)json.getProperty("deprecatedUid", 0);
+            return desc;
+        }
+
+        // Value of an option given as "--option=value", "--option value" or "-o value". JUCE only reads
+        // the first form for long options, while the usage documents the second.
+        inline juce::String getOptionValue(const juce::ArgumentList& arguments, juce::StringRef option) {
+            auto value = arguments.getValueForOption(option);
+            if (value.isNotEmpty()) return value;
+            auto index = arguments.indexOfOption(option);
+            if (index < 0 || index + 1 >= arguments.size()) return {};
+            auto& arg = arguments.arguments.getReference(index);
+            if (!arg.isLongOption() || arg.text.containsChar('=')) return {};
+            auto& next = arguments.arguments.getReference(index + 1);
+            return next.isOption() ? juce::String() : next.text;
+        }
+
+        // Like getOptionValue, resolved against the working directory; an empty File when no value was given.
+        inline juce::File getOptionFile(const juce::ArgumentList& arguments, juce::StringRef option) {
+            auto value = getOptionValue(arguments, option).unquoted();
+            return value.isEmpty() ? juce::File() : juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        }
+
+        // Plain loops over contiguous planes, left for the compiler to vectorize (-O3 -ftree-vectorize).
+        inline void convertSamples(const double* src, float* dest, int num) {
+            for (int i = 0; i < num; i++) dest[i] = (float)src[i];
+        }
+        inline void convertSamples(const float* src, double* dest, int num) {
+            for (int i = 0; i < num; i++) dest[i] = (double)src[i];
+        }
     }
 
     namespace streams {
@@ -29,7 +67,7 @@ namespace eim {
             }
 
             void write(bool var) { write((unsigned char)var); }
-            template <typename T> void write(T var) { std::fwrite(&var, sizeof(T), 1, oldStdout); }
+            template <typename T> void write(T var) { writeRaw(&var, sizeof(T), 1); }
             void write(const juce::Array<juce::String>& var) {
                 writeVarInt(var.size());
                 for (auto& str : var) write(str);
@@ -38,7 +76,7 @@ namespace eim {
                 writeVarInt(var.size());
                 for (auto& str : var) write(str);
             }
-            template <typename T> void writeArray(T* var, int len) { std::fwrite(var, sizeof(T), (size_t) len, oldStdout); }
+            template <typename T> void writeArray(T* var, int len) { writeRaw(var, sizeof(T), (size_t) len); }
             template <typename T> output_stream& operator<<(T var) { write(var); return *this; }
             output_stream& operator<<(bool var) { write(var); return *this; }
             output_stream& operator<<(const juce::String& var) { write(var); return *this; }
@@ -68,7 +106,7 @@ namespace eim {
                 auto raw = str.toRawUTF8();
                 auto len = strlen(raw);
                 writeVarInt((int)len);
-                std::fwrite(raw, sizeof(char), len, oldStdout);
+                writeRaw(raw, sizeof(char), len);
             }
             void writeAction(juce::int8 action) { write(action); }
             void writeByteOrderMessage() {
@@ -82,9 +120,37 @@ namespace eim {
                 std::cerr << str << '\n';
             }
 
-            void flush() { std::fflush(oldStdout); }
+            void flush() {
+                if (ring) ring->flush();
+                else std::fflush(oldStdout);
+            }
+
+            // Routes all following writes into a shared memory ring instead of the stdout pipe.
+            void attach(shm_ring* _ring) {
+                if (!ring) std::fflush(oldStdout);
+                ring = _ring;
+            }
+            // Drops all following ring writes once the engine went away (closed with the input stream).
+            void close() { closed = true; }
 
         private:
+            shm_ring* ring = nullptr;
+            std::atomic<bool> closed = false;
+
+            void writeRaw(const void* data, size_t size, size_t count) {
+                if (!ring) {
+                    std::fwrite(data, size, count, oldStdout);
+                    return;
+                }
+                auto len = size * count;
+                auto ptr = static_cast<const char*>(data);
+                while (len > 0 && !closed && !ring->isClosed()) { // a full ring nobody drains would block forever
+                    auto written = ring->write(ptr, len, 100);
+                    ptr += written;
+                    len -= written;
+                }
+            }
+
 #ifdef JUCE_WINDOWS
             FILE* oldStdout = _fdopen(_dup(_fileno(stdout)), "wb");
 #else
@@ -102,14 +168,14 @@ namespace eim {
 #endif
             }
 
-            static bool readBool() {
+            bool readBool() {
                 unsigned char var;
-                auto ret = std::fread(&var, 1, 1, stdin);
+                auto ret = readRaw(&var, 1, 1);
                 return ret && var != 0;
             }
-            template <typename T> size_t read(T& var) { return std::fread(&var, sizeof(T), 1, stdin); }
+            template <typename T> size_t read(T& var) { return readRaw(&var, sizeof(T), 1); }
             template <typename T> void readArray(T* var, int len) {
-                juce::ignoreUnused(std::fread(var, sizeof(T), (size_t) len, stdin));
+                juce::ignoreUnused(readRaw(var, sizeof(T), (size_t) len));
             }
             template <typename T> input_stream& operator>>(T& var) { read(var); return *this; }
             input_stream& operator>>(bool& var) { var = readBool(); return *this; }
@@ -138,11 +204,44 @@ namespace eim {
                 readVarInt(len);
                 if (len == 0) return "";
                 char* str = new char[static_cast<unsigned long>(len + 1)];
-                auto ret = std::fread(str, sizeof(char), (size_t) len, stdin);
+                auto ret = readRaw(str, sizeof(char), (size_t) len);
                 if ((int)ret < len) len = (int)ret;
                 str[len] = '\0';
                 return str;
             }
+
+            void skip(int bytes) {
+                char buf[1024];
+                for (; bytes > 0; bytes -= (int)sizeof(buf)) if (readRaw(buf, 1, (size_t)juce::jmin(bytes, (int)sizeof(buf))) == 0) return;
+            }
+
+            // Routes all following reads to a shared memory ring instead of the stdin pipe.
+            void attach(shm_ring* _ring) { ring = _ring; }
+            void close() { closed = true; }
+
+            // Copies every byte read from now on into a session recording (--record).
+            void record(session_recorder* _recorder) { recorder = _recorder; }
+            // Reads from a session recording instead of the engine (--replay).
+            void replay(session_replayer* _replayer) { replayer = _replayer; }
+
+        private:
+            shm_ring* ring = nullptr;
+            session_recorder* recorder = nullptr;
+            session_replayer* replayer = nullptr;
+            std::atomic<bool> closed = false;
+
+            size_t readRaw(void* data, size_t size, size_t count) {
+                size_t done = 0;
+                if (replayer) done = replayer->read(data, size * count);
+                else if (!ring) done = std::fread(data, size, count, stdin) * size;
+                else {
+                    auto len = size * count;
+                    auto ptr = static_cast<char*>(data);
+                    while (done < len && !closed && !ring->isClosed()) done += ring->read(ptr + done, len - done, 100);
+                }
+                if (recorder && done) recorder->append(data, done);
+                return done / size;
+            }
         };
 
         static output_stream& output() {